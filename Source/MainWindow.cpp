@@ -1,4 +1,5 @@
 ﻿#include "MainWindow.h" 
+#include <cstdio>// swprintf_s
 
 MainWindow::MainWindow()
 {
@@ -44,6 +45,14 @@ bool MainWindow::create(HINSTANCE hInstance)
         (LPVOID)this
     );
 
+    // メッシュの並べ替えの効果（三角形あたりの頂点シェーダーの実行回数）
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+    _modelViewer.getMeshACMR(&acmrBefore, &acmrAfter);
+    WCHAR message[128];
+    swprintf_s(message, L"Mesh ACMR: %.3f -> %.3f\n", acmrBefore, acmrAfter);
+    OutputDebugStringW(message);
+
     return (NULL != _hwnd);
 }
 
@@ -209,6 +218,9 @@ LRESULT MainWindow::handleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
             // DIBにシーンを描画
             _modelViewer.onPaint(&_renderingContext);
 
+            // タイル配置の描画結果をDIBへ書き出す
+            _renderingContext.resolveRenderTarget();
+
             HDC hdcSrc = CreateCompatibleDC(ps.hdc);
             HGDIOBJ hBmPrev = SelectObject(hdcSrc, _hDib);
 
@@ -260,13 +272,8 @@ void MainWindow::createFrameBuffer()
         GetObjectW(_hDib, sizeof(DIBSECTION), &dibSection);
     }
 
-    int depthByteCount = 4;// TODO: rename
-
-    _depthBuffer = std::malloc(depthByteCount * clientWidth * clientHeight);
-
     _renderingContext.setWindowSize(clientWidth, clientHeight);
     _renderingContext.setRenderTargetColorBuffer(dibSection.dsBm.bmBits, clientWidth, clientHeight, (int)dibSection.dsBm.bmWidthBytes);
-    _renderingContext.setRenderTargetDepthBuffer(_depthBuffer, clientWidth, clientHeight, depthByteCount * dibSection.dsBm.bmWidth);
     _renderingContext.setViewport(0, 0, clientWidth, clientHeight);
     _renderingContext.setViewport(50, 50, clientWidth - 100, clientHeight - 100);
 }
@@ -275,7 +282,6 @@ void MainWindow::deleteFrameBuffer()
 {
     _renderingContext.setWindowSize(0, 0);
     _renderingContext.setRenderTargetColorBuffer(nullptr, 0, 0, 0);
-    _renderingContext.setRenderTargetDepthBuffer(nullptr, 0, 0, 0);
     _renderingContext.setViewport(0, 0, 0, 0);
 
     if (NULL != _hDib)
@@ -283,10 +289,4 @@ void MainWindow::deleteFrameBuffer()
         DeleteObject(_hDib);
         _hDib = NULL;
     }
-
-    if (nullptr != _depthBuffer)
-    {
-        std::free(_depthBuffer);
-        _depthBuffer = nullptr;
-    }
 }
@@ -31,7 +31,6 @@ private:
 
     HWND _hwnd = NULL;
     HBITMAP _hDib = NULL;
-    void* _depthBuffer = nullptr;
 
     int _lastMousePosX = 0;
     int _lastMousePosY = 0;
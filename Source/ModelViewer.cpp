@@ -2,6 +2,7 @@
 #include "ModelViewer.h"
 #include "MeshData.h"
 #include "SoftwareRasterizer\Utility.h"
+#include "SoftwareRasterizer\Modules\TextureOperations.h"
 #include <cstdint>
 #include <algorithm>// clamp
 
@@ -15,6 +16,65 @@ namespace Test
         const Sampler2D* meshTexture;
     };
 
+    ModelViewer::ModelViewer()
+    {
+        prepareMesh();
+        prepareTexture();
+    }
+
+    // 回転や縮小で斜めに読んでもキャッシュに乗りやすいよう、Morton 順に並べ替えておく
+    void ModelViewer::prepareTexture()
+    {
+        Texture2D texture = {};
+        texture.addr = kTexture;
+        texture.width = 256;
+        texture.height = 256;
+        texture.widthBytes = 4 * 256;
+
+        _meshTexels.resize(TextureOperations::GetSwizzledTextureBytes(texture.width, texture.height) / sizeof(uint32_t));
+        _meshTexture.addr = _meshTexels.data();
+        TextureOperations::SwizzleTexture(&texture, &_meshTexture);
+    }
+
+    // エクスポートされたままの三角形の順序は頂点キャッシュに合っていないので並べ替えておく
+    void ModelViewer::prepareMesh()
+    {
+        const int vertexNum = kMeshVerticesLength / 3;
+
+        VertexCacheState vertexCacheState;// 描画時と同じ設定
+
+        _mesh.indices.assign(kMeshTriangles, kMeshTriangles + kMeshTrianglesLength);
+        _mesh.acmrBefore = MeshOptimizer::ComputeACMR(_mesh.indices.data(), kMeshTrianglesLength, &vertexCacheState);
+
+        // 元の順序の方が良ければそのまま使う
+        std::vector<uint16_t> optimizedIndices(_mesh.indices);
+        MeshOptimizer::OptimizeVertexCache(optimizedIndices.data(), kMeshTrianglesLength, vertexNum, vertexCacheState.entryNum);
+        if (MeshOptimizer::ComputeACMR(optimizedIndices.data(), kMeshTrianglesLength, &vertexCacheState) < _mesh.acmrBefore)
+        {
+            _mesh.indices.swap(optimizedIndices);
+        }
+
+        MeshOptimizer::OptimizeOverdraw(_mesh.indices.data(), kMeshTrianglesLength, kMeshVertices, sizeof(float) * 3, vertexNum, vertexCacheState.entryNum);
+
+        std::vector<int> remap(vertexNum);
+        MeshOptimizer::OptimizeVertexFetch(_mesh.indices.data(), kMeshTrianglesLength, vertexNum, remap.data());
+
+        _mesh.vertices.resize(vertexNum * 3);
+        _mesh.uvs.resize(vertexNum * 2);
+        _mesh.normals.resize(vertexNum * 3);
+        MeshOptimizer::RemapVertexBuffer(_mesh.vertices.data(), kMeshVertices, vertexNum, sizeof(float) * 3, remap.data());
+        MeshOptimizer::RemapVertexBuffer(_mesh.uvs.data(), kMeshUvs, vertexNum, sizeof(float) * 2, remap.data());
+        MeshOptimizer::RemapVertexBuffer(_mesh.normals.data(), kMeshNormals, vertexNum, sizeof(float) * 3, remap.data());
+
+        _mesh.acmrAfter = MeshOptimizer::ComputeACMR(_mesh.indices.data(), kMeshTrianglesLength, &vertexCacheState);
+    }
+
+    void ModelViewer::getMeshACMR(float* acmrBefore, float* acmrAfter) const
+    {
+        *acmrBefore = _mesh.acmrBefore;
+        *acmrAfter = _mesh.acmrAfter;
+    }
+
     void ModelViewer::onLButtonDrag(int xDelta, int yDelta)
     {
         _camera.angleX += yDelta * 0.01f;
@@ -70,6 +130,50 @@ namespace Test
         output->varyings[0] = color;
     }
 
+    // SoA の頂点に行列を掛ける
+    static void TransformBatch(const Matrix4x4& m, const float (*v)[kVertexBatchMaxSize], float (*result)[kVertexBatchMaxSize], int vertexNum)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            Vector4 r = m.getRow(row);
+            for (int i = 0; i < vertexNum; i++)
+            {
+                result[row][i] = (r.x * v[0][i]) + (r.y * v[1][i]) + (r.z * v[2][i]) + (r.w * v[3][i]);
+            }
+        }
+    }
+
+    void LineVertexShaderBatchMain(const VertexBatchShaderInput* input, VertexBatchShaderOutput* output)
+    {
+        const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
+        const Matrix4x4& projectionMatrix = uniformBlock->projectionMatrix;
+        const Matrix4x4 modelViewMatrix = uniformBlock->viewMatrix * uniformBlock->modelMatrix;
+        const float (*position)[kVertexBatchMaxSize] = input->attributes[0];
+        const float (*color)[kVertexBatchMaxSize] = input->attributes[1];
+        int vertexNum = input->vertexNum;
+
+        float p[4][kVertexBatchMaxSize];
+        for (int i = 0; i < vertexNum; i++)
+        {
+            p[0][i] = position[0][i];
+            p[1][i] = position[1][i];
+            p[2][i] = position[2][i];
+            p[3][i] = 1.0f;
+        }
+
+        float viewPosition[4][kVertexBatchMaxSize];
+        TransformBatch(modelViewMatrix, p, viewPosition, vertexNum);
+        TransformBatch(projectionMatrix, viewPosition, output->position, vertexNum);
+
+        for (int c = 0; c < 4; c++)
+        {
+            for (int i = 0; i < vertexNum; i++)
+            {
+                output->varyings[0][c][i] = color[c][i];
+            }
+        }
+    }
+
     void LinePixelShaderMain(const FragmentShaderInput* input, FragmentShaderOutput* output)
     {
         const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
@@ -78,6 +182,30 @@ namespace Test
         output->fragColor = color;
     }
 
+    void LinePixelShaderBatchMain(const FragmentBatchShaderInput* input, FragmentBatchShaderOutput* output)
+    {
+        const float (*color)[kFragmentBatchSize] = input->varyings[0];
+
+        for (int c = 0; c < 4; c++)
+        {
+            for (int i = 0; i < kFragmentBatchSize; i++)
+            {
+                output->fragColor[c][i] = color[c][i];
+            }
+        }
+    }
+
+    // 関数オブジェクト版（RenderingContext のテンプレート版の描画でインライン展開される）
+    struct LineVertexShader
+    {
+        void operator()(const VertexShaderInput* input, VertexShaderOutput* output) const { LineVertexShaderMain(input, output); }
+    };
+
+    struct LinePixelShader
+    {
+        void operator()(const FragmentShaderInput* input, FragmentShaderOutput* output) const { LinePixelShaderMain(input, output); }
+    };
+
     void MeshVertexShaderMain(const VertexShaderInput* input, VertexShaderOutput* output)
     {
         const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
@@ -93,6 +221,40 @@ namespace Test
         output->varyings[1] = modelMatrix * normal;
     }
 
+    void MeshVertexShaderBatchMain(const VertexBatchShaderInput* input, VertexBatchShaderOutput* output)
+    {
+        const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
+        const Matrix4x4& projectionMatrix = uniformBlock->projectionMatrix;
+        const Matrix4x4& modelMatrix = uniformBlock->modelMatrix;
+        const Matrix4x4 modelViewMatrix = uniformBlock->viewMatrix * modelMatrix;
+        const float (*position)[kVertexBatchMaxSize] = input->attributes[0];
+        const float (*uv)[kVertexBatchMaxSize] = input->attributes[1];
+        const float (*normal)[kVertexBatchMaxSize] = input->attributes[2];
+        int vertexNum = input->vertexNum;
+
+        float p[4][kVertexBatchMaxSize];
+        for (int i = 0; i < vertexNum; i++)
+        {
+            p[0][i] = position[0][i];
+            p[1][i] = position[1][i];
+            p[2][i] = position[2][i];
+            p[3][i] = 1.0f;
+        }
+
+        float viewPosition[4][kVertexBatchMaxSize];
+        TransformBatch(modelViewMatrix, p, viewPosition, vertexNum);
+        TransformBatch(projectionMatrix, viewPosition, output->position, vertexNum);
+
+        for (int c = 0; c < 4; c++)
+        {
+            for (int i = 0; i < vertexNum; i++)
+            {
+                output->varyings[0][c][i] = uv[c][i];
+            }
+        }
+        TransformBatch(modelMatrix, normal, output->varyings[1], vertexNum);
+    }
+
     void MeshPixelShaderMain(const FragmentShaderInput* input, FragmentShaderOutput* output)
     {
         const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
@@ -102,6 +264,15 @@ namespace Test
         output->fragColor = SamplerUtility::SampleTexture2d(uniformBlock->meshTexture, uv);
     }
 
+    void MeshPixelShaderBatchMain(const FragmentBatchShaderInput* input, FragmentBatchShaderOutput* output)
+    {
+        const UniformBlock* uniformBlock = (const UniformBlock*)input->uniformBlock;
+        const float (*uv)[kFragmentBatchSize] = input->varyings[0];
+
+        // フィルタとラップモードは CompileSampler で選んだ関数が持っている
+        SamplerUtility::SampleTexture2dBatch(uniformBlock->meshTexture, uv, input->activeMask, output->fragColor);
+    }
+
     void ModelViewer::renderScene(RenderingContext* renderingContext)
     {
         UniformBlock uniformBlock = {};
@@ -159,8 +330,8 @@ namespace Test
             renderingContext->setVertexAttribute(1, 4, ComponentDataType::kFloat, sizeof(Vector4), gridColors);
             renderingContext->setIndexBuffer(gridIndices, 2 * 2 * gridSize);
             renderingContext->enableVarying(0);
-            renderingContext->setVertexShaderProgram(LineVertexShaderMain);
-            renderingContext->setFragmentShaderProgram(LinePixelShaderMain);
+            renderingContext->setVertexShaderProgram(LineVertexShaderMain, LineVertexShaderBatchMain);
+            renderingContext->setFragmentShaderProgram(LinePixelShaderMain, LinePixelShaderBatchMain);
 
             renderingContext->drawIndexed(PrimitiveTopologyType::kLineList);
 
@@ -172,32 +343,36 @@ namespace Test
         // 座標軸を描画
         {
             const uint16_t axisIndices[2] = { 0, 1 };
-            const Vector3 xAxisPositions[2] = { { 0.0f, 0.0f, 0.0f }, { 1.0f,  0.0f,  0.0f } };
-            const Vector4 xAxisColors[2] = { { 1.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } };
-            const Vector3 yAxisPositions[2] = { { 0.0f, 0.0f, 0.0f }, { 0.0f,  1.0f,  0.0f } };
-            const Vector4 yAxisColors[2] = { { 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } };
-            const Vector3 zAxisPositions[2] = { { 0.0f, 0.0f, 0.0f }, { 0.0f,  0.0f,  1.0f } };
-            const Vector4 zAxisColors[2] = { { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } };
+            const Vector3 axisPositions[6] =
+            {
+                { 0.0f, 0.0f, 0.0f }, { 1.0f,  0.0f,  0.0f },
+                { 0.0f, 0.0f, 0.0f }, { 0.0f,  1.0f,  0.0f },
+                { 0.0f, 0.0f, 0.0f }, { 0.0f,  0.0f,  1.0f },
+            };
+            const Vector4 axisColors[6] =
+            {
+                { 1.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f },
+                { 0.0f, 1.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f },
+                { 0.0f, 0.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f },
+            };
+
+            // x / y / z 軸を baseVertex で切り替えて一度に描画
+            const DrawIndexedIndirectCommand axisDraws[3] =
+            {
+                { 2, 0, 0, 1 },
+                { 2, 0, 2, 1 },
+                { 2, 0, 4, 1 },
+            };
 
             renderingContext->setIndexBuffer(axisIndices, 2);
             renderingContext->enableVertexAttribute(0);
-            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(Vector3), xAxisPositions);
+            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(Vector3), axisPositions);
             renderingContext->enableVertexAttribute(1);
-            renderingContext->setVertexAttribute(1, 4, ComponentDataType::kFloat, sizeof(Vector4), xAxisColors);
+            renderingContext->setVertexAttribute(1, 4, ComponentDataType::kFloat, sizeof(Vector4), axisColors);
             renderingContext->enableVarying(0);
-            renderingContext->setVertexShaderProgram(LineVertexShaderMain);
-            renderingContext->setFragmentShaderProgram(LinePixelShaderMain);
             renderingContext->setDepthFunc(ComparisonFunc::kLessEqual);
 
-            renderingContext->drawIndexed(PrimitiveTopologyType::kLineList);
-
-            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(Vector3), yAxisPositions);
-            renderingContext->setVertexAttribute(1, 4, ComponentDataType::kFloat, sizeof(Vector4), yAxisColors);
-            renderingContext->drawIndexed(PrimitiveTopologyType::kLineList);
-
-            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(Vector3), zAxisPositions);
-            renderingContext->setVertexAttribute(1, 4, ComponentDataType::kFloat, sizeof(Vector4), zAxisColors);
-            renderingContext->drawIndexed(PrimitiveTopologyType::kLineList);
+            renderingContext->multiDrawIndexedIndirect(PrimitiveTopologyType::kLineList, axisDraws, 3, LineVertexShader(), LinePixelShader());
 
             renderingContext->disableVertexAttribute(0);
             renderingContext->disableVertexAttribute(1);
@@ -236,24 +411,20 @@ namespace Test
         {
             // (-3, 2) (-1, 2)
             // (-3, 0) (-1, 0)
-            const uint16_t polygonIndices[6] = { 0, 1, 2, 1, 3, 2 };
+            const uint16_t polygonIndices[4] = { 0, 1, 2, 3 };
             const Vector3 polygonPositions[4] = { { -3.0f, 2.0f, 0.0f }, { -1.0f, 2.0f,  0.0f }, { -3.0f,  0.0f,  0.0f }, { -1.0f, 0.0f,  0.0f } };
             const Vector2 polygonUVs[4] = { { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 0.0f, 0.0f }, { 1.0f, 0.0f } };
             const Vector3 polygonNormals[4] = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f  }, { 0.0f, 0.0f, 1.0f  }, { 0.0f, 0.0f, 1.0f  } };
 
-            Texture2D texture = {};
-            texture.addr = kTexture;
-            texture.width = 256;
-            texture.height = 256;
-            texture.widthBytes = 4 * 256;
-
             Sampler2D sampler = {};
-            sampler.texture = &texture;
-            sampler.filter = FilterType::kBilinear;
+            sampler.texture = &_meshTexture;
+            sampler.minFilter = FilterType::kBilinear;
+            sampler.magFilter = FilterType::kBilinear;
+            TextureMappingUnit::CompileSampler(&sampler);
 
             uniformBlock.meshTexture = &sampler;
 
-            renderingContext->setIndexBuffer(polygonIndices, 6);
+            renderingContext->setIndexBuffer(polygonIndices, 4);
             renderingContext->enableVertexAttribute(0);
             renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(Vector3), polygonPositions);
             renderingContext->enableVertexAttribute(1);
@@ -262,11 +433,11 @@ namespace Test
             renderingContext->setVertexAttribute(2, 3, ComponentDataType::kFloat, sizeof(Vector3), polygonNormals);
             renderingContext->enableVarying(0);
             renderingContext->enableVarying(1);
-            renderingContext->setVertexShaderProgram(MeshVertexShaderMain);
-            renderingContext->setFragmentShaderProgram(MeshPixelShaderMain);
+            renderingContext->setVertexShaderProgram(MeshVertexShaderMain, MeshVertexShaderBatchMain);
+            renderingContext->setFragmentShaderProgram(MeshPixelShaderMain, MeshPixelShaderBatchMain);
             renderingContext->setFrontFaceMode(FrontFaceMode::kClockwise);
 
-            renderingContext->drawIndexed(PrimitiveTopologyType::kTriangleList);
+            renderingContext->drawIndexed(PrimitiveTopologyType::kTriangleStrip);
 
             renderingContext->disableVertexAttribute(0);
             renderingContext->disableVertexAttribute(1);
@@ -283,32 +454,30 @@ namespace Test
         {
             uniformBlock.modelMatrix = TransformMatrix::CreateRotationX(90.0f * 3.14f / 180.0f);
 
-            Texture2D texture = {};
-            texture.addr = kTexture;
-            texture.width = 256;
-            texture.height = 256;
-            texture.widthBytes = 4 * 256;
-
             Sampler2D sampler = {};
-            sampler.texture = &texture;
-            sampler.filter = FilterType::kBilinear;
+            sampler.texture = &_meshTexture;
+            sampler.minFilter = FilterType::kBilinear;
+            sampler.magFilter = FilterType::kBilinear;
+            TextureMappingUnit::CompileSampler(&sampler);
 
             uniformBlock.meshTexture = &sampler;
 
-            renderingContext->setIndexBuffer(kMeshTriangles, kMeshTrianglesLength);
+            renderingContext->setIndexBuffer(_mesh.indices.data(), (int)_mesh.indices.size());
             renderingContext->enableVertexAttribute(0);
-            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(float) * 3, kMeshVertices);
+            renderingContext->setVertexAttribute(0, 3, ComponentDataType::kFloat, sizeof(float) * 3, _mesh.vertices.data());
             renderingContext->enableVertexAttribute(1);
-            renderingContext->setVertexAttribute(1, 2, ComponentDataType::kFloat, sizeof(float) * 2, kMeshUvs);
+            renderingContext->setVertexAttribute(1, 2, ComponentDataType::kFloat, sizeof(float) * 2, _mesh.uvs.data());
             renderingContext->enableVertexAttribute(2);
-            renderingContext->setVertexAttribute(2, 3, ComponentDataType::kFloat, sizeof(float) * 3, kMeshNormals);
+            renderingContext->setVertexAttribute(2, 3, ComponentDataType::kFloat, sizeof(float) * 3, _mesh.normals.data());
             renderingContext->enableVarying(0);
             renderingContext->enableVarying(1);
-            renderingContext->setVertexShaderProgram(MeshVertexShaderMain);
-            renderingContext->setFragmentShaderProgram(MeshPixelShaderMain);
+            renderingContext->setVertexShaderProgram(MeshVertexShaderMain, MeshVertexShaderBatchMain);
+            renderingContext->setFragmentShaderProgram(MeshPixelShaderMain, MeshPixelShaderBatchMain);
+            renderingContext->setVertexProcessingMode(VertexProcessingMode::kPreTransform);
 
             renderingContext->drawIndexed(PrimitiveTopologyType::kTriangleList);
 
+            renderingContext->setVertexProcessingMode(VertexProcessingMode::kDefault);
             renderingContext->disableVertexAttribute(0);
             renderingContext->disableVertexAttribute(1);
             renderingContext->disableVertexAttribute(2);
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include "SoftwareRasterizer\RenderingContext.h"
+#include <cstdint>
+#include <vector>
 
 namespace Test
 {
@@ -10,7 +12,11 @@ namespace Test
     {
 
     public:
-        
+
+        ModelViewer();
+
+        void getMeshACMR(float* acmrBefore, float* acmrAfter) const;
+
         void onLButtonDrag(int xDelta, int yDelta);
         void onMouseWweel(int zDelta);
         void onKeyDown(int vk);
@@ -18,8 +24,22 @@ namespace Test
 
     private:
 
+        void prepareMesh();
+        void prepareTexture();
         void renderScene(RenderingContext* renderingContext);
 
+        // 描画用に並べ替えたメッシュ
+        struct Mesh
+        {
+            std::vector<uint16_t> indices;
+            std::vector<float> vertices;
+            std::vector<float> uvs;
+            std::vector<float> normals;
+
+            float acmrBefore = 0.0f;
+            float acmrAfter = 0.0f;
+        };
+
         struct MainCamera
         {
             float fovY = 60.0f * (3.14159265359f / 180.0f);
@@ -38,6 +58,11 @@ namespace Test
         };
 
         MainCamera _camera;
+        Mesh _mesh;
+
+        // Morton 順に並べ替えたテクスチャ
+        std::vector<uint32_t> _meshTexels;
+        Texture2D _meshTexture;
 
     };
 }
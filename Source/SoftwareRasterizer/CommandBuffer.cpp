@@ -0,0 +1,238 @@
+﻿#include "CommandBuffer.h"
+#include <algorithm>// clamp
+#include <cassert>
+
+namespace SoftwareRasterizer
+{
+    CommandBuffer::CommandBuffer()
+    {
+    }
+
+    void CommandBuffer::reset()
+    {
+        _commands.clear();
+        _indexNum = 0;
+    }
+
+    Command* CommandBuffer::appendCommand(CommandType type)
+    {
+        Command* command = &(_commands.emplace_back());
+        command->type = type;
+        return command;
+    }
+
+    void CommandBuffer::clearRenderTarget(float red, float green, float blue, float alpha, float depth)
+    {
+        Command* command = appendCommand(CommandType::kClearRenderTarget);
+        command->clear.color[0] = std::clamp(red, 0.0f, 1.0f);
+        command->clear.color[1] = std::clamp(green, 0.0f, 1.0f);
+        command->clear.color[2] = std::clamp(blue, 0.0f, 1.0f);
+        command->clear.color[3] = std::clamp(alpha, 0.0f, 1.0f);
+        command->clear.depth = std::clamp(depth, 0.0f, 1.0f);
+    }
+
+    void CommandBuffer::setUniformBlock(const void* uniformBlock)
+    {
+        appendCommand(CommandType::kSetUniformBlock)->uniformBlock = uniformBlock;
+    }
+
+    void CommandBuffer::enableVertexAttribute(int index)
+    {
+        assert(0 <= index && index < kMaxVertexAttributes);
+        appendCommand(CommandType::kEnableVertexAttribute)->index = index;
+    }
+
+    void CommandBuffer::disableVertexAttribute(int index)
+    {
+        assert(0 <= index && index < kMaxVertexAttributes);
+        appendCommand(CommandType::kDisableVertexAttribute)->index = index;
+    }
+
+    void CommandBuffer::setVertexAttribute(int index, int size, ComponentDataType type, size_t stride, const void* buffer)
+    {
+        assert(0 <= index && index < kMaxVertexAttributes);
+        Command* command = appendCommand(CommandType::kSetVertexAttribute);
+        command->vertexAttribute.index = index;
+        command->vertexAttribute.size = size;
+        command->vertexAttribute.type = type;
+        command->vertexAttribute.stride = stride;
+        command->vertexAttribute.buffer = buffer;
+    }
+
+    void CommandBuffer::setVertexAttributeDivisor(int index, int divisor)
+    {
+        assert(0 <= index && index < kMaxVertexAttributes);
+        assert(0 <= divisor);
+        Command* command = appendCommand(CommandType::kSetVertexAttributeDivisor);
+        command->vertexAttributeDivisor.index = index;
+        command->vertexAttributeDivisor.divisor = divisor;
+    }
+
+    void CommandBuffer::setIndexBuffer(const uint16_t* indices, int indexNum)
+    {
+        Command* command = appendCommand(CommandType::kSetIndexBuffer);
+        command->indexBuffer.indices = indices;
+        command->indexBuffer.indexType = IndexType::kUnsignedShort;
+        command->indexBuffer.indexNum = indexNum;
+        _indexNum = indexNum;
+    }
+
+    void CommandBuffer::setIndexBuffer(const uint32_t* indices, int indexNum)
+    {
+        Command* command = appendCommand(CommandType::kSetIndexBuffer);
+        command->indexBuffer.indices = indices;
+        command->indexBuffer.indexType = IndexType::kUnsignedInt;
+        command->indexBuffer.indexNum = indexNum;
+        _indexNum = indexNum;
+    }
+
+    void CommandBuffer::enablePrimitiveRestart()
+    {
+        appendCommand(CommandType::kSetPrimitiveRestart)->primitiveRestartEnabled = true;
+    }
+
+    void CommandBuffer::disablePrimitiveRestart()
+    {
+        appendCommand(CommandType::kSetPrimitiveRestart)->primitiveRestartEnabled = false;
+    }
+
+    void CommandBuffer::enableVarying(int index)
+    {
+        assert(0 <= index && index < kMaxVaryings);
+        appendCommand(CommandType::kEnableVarying)->index = index;
+    }
+
+    void CommandBuffer::disableVarying(int index)
+    {
+        assert(0 <= index && index < kMaxVaryings);
+        appendCommand(CommandType::kDisableVarying)->index = index;
+    }
+
+    void CommandBuffer::setVertexProcessingMode(VertexProcessingMode vertexProcessingMode)
+    {
+        appendCommand(CommandType::kSetVertexProcessingMode)->vertexProcessingMode = vertexProcessingMode;
+    }
+
+    void CommandBuffer::setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain, VertexBatchShaderFuncPtr vertexBatchShaderMain)
+    {
+        assert(vertexShaderMain);
+        Command* command = appendCommand(CommandType::kSetVertexShaderProgram);
+        command->vertexShaderProgram.vertexShaderMain = vertexShaderMain;
+        command->vertexShaderProgram.vertexBatchShaderMain = vertexBatchShaderMain;
+    }
+
+    void CommandBuffer::setViewport(int x, int y, int width, int height)
+    {
+        assert(0 <= width && 0 <= height);
+        Command* command = appendCommand(CommandType::kSetViewport);
+        command->viewport.x = x;
+        command->viewport.y = y;
+        command->viewport.width = width;
+        command->viewport.height = height;
+    }
+
+    void CommandBuffer::setDepthRange(float nearVal, float farVal)
+    {
+        Command* command = appendCommand(CommandType::kSetDepthRange);
+        command->depthRange.nearVal = nearVal;
+        command->depthRange.farVal = farVal;
+    }
+
+    void CommandBuffer::setFrontFaceMode(FrontFaceMode frontFaceMode)
+    {
+        appendCommand(CommandType::kSetFrontFaceMode)->frontFaceMode = frontFaceMode;
+    }
+
+    void CommandBuffer::setCullFaceMode(CullFaceMode cullFaceMode)
+    {
+        appendCommand(CommandType::kSetCullFaceMode)->cullFaceMode = cullFaceMode;
+    }
+
+    void CommandBuffer::setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain, FragmentBatchShaderFuncPtr fragmentBatchShaderMain)
+    {
+        assert(fragmentShaderMain);
+        Command* command = appendCommand(CommandType::kSetFragmentShaderProgram);
+        command->fragmentShaderProgram.fragmentShaderMain = fragmentShaderMain;
+        command->fragmentShaderProgram.fragmentBatchShaderMain = fragmentBatchShaderMain;
+    }
+
+    void CommandBuffer::setDepthFunc(ComparisonFunc depthFunc)
+    {
+        appendCommand(CommandType::kSetDepthFunc)->depthFunc = depthFunc;
+    }
+
+    void CommandBuffer::appendDraw(const DrawCommandParam& param)
+    {
+        // 何も描かない描画は記録しない
+        if ((0 == param.count) || (0 == param.instanceCount))
+        {
+            return;
+        }
+
+        appendCommand(CommandType::kDraw)->draw = param;
+    }
+
+    void CommandBuffer::drawIndexed(PrimitiveTopologyType primitiveTopologyType)
+    {
+        drawIndexedBaseVertex(primitiveTopologyType, 0, _indexNum, 0);
+    }
+
+    void CommandBuffer::drawIndexedBaseVertex(PrimitiveTopologyType primitiveTopologyType, int first, int count, int baseVertex)
+    {
+        assert(0 <= first && 0 <= count);
+        assert((first + count) <= _indexNum);
+
+        DrawCommandParam param;
+        param.primitiveTopologyType = primitiveTopologyType;
+        param.indexed = true;
+        param.first = first;
+        param.count = count;
+        param.baseVertex = baseVertex;
+        param.instanceCount = 1;
+        appendDraw(param);
+    }
+
+    void CommandBuffer::drawArrays(PrimitiveTopologyType primitiveTopologyType, int first, int count)
+    {
+        assert(0 <= first && 0 <= count);
+
+        DrawCommandParam param;
+        param.primitiveTopologyType = primitiveTopologyType;
+        param.indexed = false;
+        param.first = first;
+        param.count = count;
+        param.baseVertex = 0;
+        param.instanceCount = 1;
+        appendDraw(param);
+    }
+
+    void CommandBuffer::drawIndexedInstanced(PrimitiveTopologyType primitiveTopologyType, int instanceCount)
+    {
+        assert(0 <= instanceCount);
+
+        DrawCommandParam param;
+        param.primitiveTopologyType = primitiveTopologyType;
+        param.indexed = true;
+        param.first = 0;
+        param.count = _indexNum;
+        param.baseVertex = 0;
+        param.instanceCount = instanceCount;
+        appendDraw(param);
+    }
+
+    void CommandBuffer::multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount)
+    {
+        assert(0 <= drawCount);
+
+        // 引数の内容はカリング等で実行までに書き換えられてよいので、検証は実行時に行う
+        if (0 == drawCount)
+        {
+            return;
+        }
+
+        Command* command = appendCommand(CommandType::kDrawIndexedIndirect);
+        command->drawIndirect.primitiveTopologyType = primitiveTopologyType;
+        command->drawIndirect.commands = commands;
+        command->drawIndirect.drawCount = drawCount;
+    }
+}
@@ -0,0 +1,201 @@
+﻿#pragma once
+
+#include "State\InputLayout.h"
+#include "State\IndexBuffer.h"
+#include "State\DrawParam.h"
+#include "State\VertexShaderProgram.h"
+#include "State\FragmentShaderProgram.h"
+#include "State\RasterizerState.h"
+#include "State\VertexProcessingState.h"
+#include "Core\Types.h"
+#include <cstdint>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    enum class CommandType : uint8_t
+    {
+        kClearRenderTarget,
+        kSetUniformBlock,
+        kEnableVertexAttribute,
+        kDisableVertexAttribute,
+        kSetVertexAttribute,
+        kSetVertexAttributeDivisor,
+        kSetIndexBuffer,
+        kSetPrimitiveRestart,
+        kEnableVarying,
+        kDisableVarying,
+        kSetVertexProcessingMode,
+        kSetVertexShaderProgram,
+        kSetViewport,
+        kSetDepthRange,
+        kSetFrontFaceMode,
+        kSetCullFaceMode,
+        kSetFragmentShaderProgram,
+        kSetDepthFunc,
+        kDraw,
+        kDrawIndexedIndirect,
+    };
+
+    struct ClearCommandParam
+    {
+        float color[4];
+        float depth;
+    };
+
+    struct VertexAttributeCommandParam
+    {
+        int index;
+        int size;
+        ComponentDataType type;
+        size_t stride;
+        const void* buffer;
+    };
+
+    struct VertexAttributeDivisorCommandParam
+    {
+        int index;
+        int divisor;
+    };
+
+    struct IndexBufferCommandParam
+    {
+        const void* indices;
+        IndexType indexType;
+        int indexNum;
+    };
+
+    struct VertexShaderProgramCommandParam
+    {
+        VertexShaderFuncPtr vertexShaderMain;
+        VertexBatchShaderFuncPtr vertexBatchShaderMain;
+    };
+
+    struct ViewportCommandParam
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    struct DepthRangeCommandParam
+    {
+        float nearVal;
+        float farVal;
+    };
+
+    struct FragmentShaderProgramCommandParam
+    {
+        FragmentShaderFuncPtr fragmentShaderMain;
+        FragmentBatchShaderFuncPtr fragmentBatchShaderMain;
+    };
+
+    struct DrawCommandParam
+    {
+        PrimitiveTopologyType primitiveTopologyType;
+        bool indexed;
+        int first;
+        int count;
+        int baseVertex;
+        int instanceCount;
+    };
+
+    struct DrawIndirectCommandParam
+    {
+        PrimitiveTopologyType primitiveTopologyType;
+        const DrawIndexedIndirectCommand* commands;// 実行時に読む
+        int drawCount;
+    };
+
+    struct Command
+    {
+        CommandType type;
+        union
+        {
+            ClearCommandParam clear;
+            const void* uniformBlock;
+            int index;
+            VertexAttributeCommandParam vertexAttribute;
+            VertexAttributeDivisorCommandParam vertexAttributeDivisor;
+            IndexBufferCommandParam indexBuffer;
+            bool primitiveRestartEnabled;
+            VertexProcessingMode vertexProcessingMode;
+            VertexShaderProgramCommandParam vertexShaderProgram;
+            ViewportCommandParam viewport;
+            DepthRangeCommandParam depthRange;
+            FrontFaceMode frontFaceMode;
+            CullFaceMode cullFaceMode;
+            FragmentShaderProgramCommandParam fragmentShaderProgram;
+            ComparisonFunc depthFunc;
+            DrawCommandParam draw;
+            DrawIndirectCommandParam drawIndirect;
+        };
+    };
+
+    // RenderingContext への設定と描画を記録しておき、RenderingContext::executeCommandBuffer でまとめて実行する
+    // 引数の検証は記録時に済ませる。別々の CommandBuffer であれば複数のスレッドから同時に記録してよい
+    class CommandBuffer
+    {
+
+    public:
+
+        CommandBuffer();
+
+        void reset();
+
+        void clearRenderTarget(float red, float green, float blue, float alpha, float depth);// glClearColor + glClearDepth + glClear
+
+        void setUniformBlock(const void* uniformBlock);
+
+        void enableVertexAttribute(int index);// glEnableVertexAttribArray
+        void disableVertexAttribute(int index);// glDisableVertexAttribArray
+        void setVertexAttribute(int index, int size, ComponentDataType type, size_t stride, const void* buffer);// glVertexAttribPointer
+        void setVertexAttributeDivisor(int index, int divisor);// glVertexAttribDivisor
+
+        void setIndexBuffer(const uint16_t* indices, int indexNum);// glBufferData
+        void setIndexBuffer(const uint32_t* indices, int indexNum);// glBufferData
+        void enablePrimitiveRestart();// glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+        void disablePrimitiveRestart();// glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+
+        void enableVarying(int index);
+        void disableVarying(int index);
+
+        void setVertexProcessingMode(VertexProcessingMode vertexProcessingMode);
+
+        void setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain, VertexBatchShaderFuncPtr vertexBatchShaderMain = nullptr);// glUseProgram
+
+        void setViewport(int x, int y, int width, int height);// glViewport
+
+        void setDepthRange(float nearVal, float farVal);// glDepthRange
+
+        void setFrontFaceMode(FrontFaceMode frontFaceMode);// glFrontFace
+        void setCullFaceMode(CullFaceMode cullFaceMode);// glCullFace
+
+        void setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain, FragmentBatchShaderFuncPtr fragmentBatchShaderMain = nullptr);// glUseProgram
+
+        void setDepthFunc(ComparisonFunc depthFunc);// glDepthFunc
+
+        void drawIndexed(PrimitiveTopologyType primitiveTopologyType);// glDrawElements
+        void drawIndexedBaseVertex(PrimitiveTopologyType primitiveTopologyType, int first, int count, int baseVertex);// glDrawElementsBaseVertex
+        void drawArrays(PrimitiveTopologyType primitiveTopologyType, int first, int count);// glDrawArrays
+        void drawIndexedInstanced(PrimitiveTopologyType primitiveTopologyType, int instanceCount);// glDrawElementsInstanced
+        void multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount);// glMultiDrawElementsIndirect
+
+        const Command* getCommands() const { return _commands.data(); }
+        int getCommandNum() const { return (int)_commands.size(); }
+
+    private:
+
+        Command* appendCommand(CommandType type);
+        void appendDraw(const DrawCommandParam& param);
+
+    private:
+
+        std::vector<Command> _commands;
+
+        // 記録時の検証用
+        int _indexNum = 0;
+
+    };
+}
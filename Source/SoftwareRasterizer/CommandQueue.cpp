@@ -0,0 +1,28 @@
+﻿#include "CommandQueue.h"
+#include "RenderingContext.h"
+#include <algorithm>// stable_sort
+
+namespace SoftwareRasterizer
+{
+    void CommandQueue::submit(const CommandBuffer* commandBuffer, int sortKey)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _submissions.push_back({ commandBuffer, sortKey });
+    }
+
+    void CommandQueue::execute(RenderingContext* renderingContext)
+    {
+        std::vector<Submission> submissions;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            submissions.swap(_submissions);
+        }
+
+        std::stable_sort(submissions.begin(), submissions.end(), [](const Submission& lhs, const Submission& rhs) { return lhs.sortKey < rhs.sortKey; });
+
+        for (const Submission& submission : submissions)
+        {
+            renderingContext->executeCommandBuffer(submission.commandBuffer);
+        }
+    }
+}
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include "CommandBuffer.h"
+#include <mutex>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    class RenderingContext;
+
+    // 記録済みの CommandBuffer を受け付けて、RenderingContext でまとめて実行する
+    // submit は複数のスレッドから呼んでよい
+    class CommandQueue
+    {
+
+    public:
+
+        // sortKey の小さい順に実行する（同じ sortKey なら提出順）
+        void submit(const CommandBuffer* commandBuffer, int sortKey = 0);
+
+        // 提出された CommandBuffer をすべて実行して空にする
+        void execute(RenderingContext* renderingContext);
+
+    private:
+
+        struct Submission
+        {
+            const CommandBuffer* commandBuffer;
+            int sortKey;
+        };
+
+        std::mutex _mutex;
+        std::vector<Submission> _submissions;
+
+    };
+}
@@ -30,6 +30,10 @@ namespace SoftwareRasterizer
         kNone,
         kLineList,      // GL_LINES
         kTriangleList,  // GL_TRIANGLES
+        kLineStrip,     // GL_LINE_STRIP
+        kLineLoop,      // GL_LINE_LOOP
+        kTriangleStrip, // GL_TRIANGLE_STRIP
+        kTriangleFan,   // GL_TRIANGLE_FAN
     };
 
     enum class PrimitiveType
@@ -48,12 +52,14 @@ namespace SoftwareRasterizer
     struct VertexDataA// TODO: renmae
     {
         int vertexId;// gl_VertexID
+        int instanceId;// gl_InstanceID
         Vector4 attributes[kMaxVertexAttributes];
     };
 
     struct VertexDataB// TODO: renmae
     {
         Vector4 clipCoord;// 頂点座標（クリップ空間）
+        uint32_t outcode;// 外側にあるクリップ平面のビット（頂点シェーダーの後で求める）
         Vector4 varyings[kMaxVaryings];
     };
 
@@ -72,6 +78,20 @@ namespace SoftwareRasterizer
         Vector4 varyingsDividedByW[kMaxVaryings];
     };
 
+    // まとめて頂点シェーダーに渡す頂点の最大数
+    const int kVertexBatchMaxSize = 64;
+
+    // 頂点のバッチ（SoA）
+    struct VertexBatchData
+    {
+        int vertexNum;
+        int vertexIds[kVertexBatchMaxSize];
+        float attributes[kMaxVertexAttributes][4][kVertexBatchMaxSize];// [attribute][xyzw][lane]
+        float clipCoord[4][kVertexBatchMaxSize];// [xyzw][lane]
+        uint32_t outcodes[kVertexBatchMaxSize];// [lane]
+        float varyings[kMaxVaryings][4][kVertexBatchMaxSize];// [varying][xyzw][lane]
+    };
+
     struct IntVector2
     {
         int x;
@@ -102,12 +122,30 @@ namespace SoftwareRasterizer
         FragmentData q11;
     };
 
+    // SIMD 幅でまとめて処理するフラグメントの数
+    const int kFragmentBatchSize = 8;
+
+    // フラグメントのバッチ（SoA）
+    struct FragmentBatchData
+    {
+        int fragmentNum;
+        IntVector2 pixelCoords[kFragmentBatchSize];
+        float fragCoord[4][kFragmentBatchSize];// [xyzw][lane] = (wndCoord, depth, invW)
+        float varyings[kMaxVaryings][4][kFragmentBatchSize];// [varying][xyzw][lane]
+    };
+
     struct PixelData
     {
         Vector4 color;
         float depth;
     };
 
+    struct PixelBatchData
+    {
+        float color[4][kFragmentBatchSize];// [rgba][lane]
+        float depth[kFragmentBatchSize];
+    };
+
     struct QuadPixelData
     {
         PixelData q00;// q = Quad
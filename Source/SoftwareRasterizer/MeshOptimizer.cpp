@@ -0,0 +1,371 @@
+﻿
+#include "MeshOptimizer.h"
+#include "Modules\VertexCache.h"
+#include <vector>
+#include <algorithm>// stable_sort, fill
+#include <cstring>// memcpy
+#include <cassert>
+
+namespace SoftwareRasterizer
+{
+    namespace
+    {
+        // 頂点ごとに、その頂点を参照する三角形の一覧
+        struct TriangleAdjacency
+        {
+            std::vector<int> offsets;   // [vertexNum + 1]
+            std::vector<int> triangles; // [indexNum]
+        };
+
+        void BuildTriangleAdjacency(const uint16_t* indices, int indexNum, int vertexNum, TriangleAdjacency* adjacency)
+        {
+            adjacency->offsets.assign(vertexNum + 1, 0);
+            for (int i = 0; i < indexNum; i++)
+            {
+                adjacency->offsets[indices[i] + 1]++;
+            }
+            for (int i = 0; i < vertexNum; i++)
+            {
+                adjacency->offsets[i + 1] += adjacency->offsets[i];
+            }
+
+            std::vector<int> fillCounts(adjacency->offsets.begin(), adjacency->offsets.end() - 1);
+            adjacency->triangles.resize(indexNum);
+            for (int i = 0; i < indexNum; i++)
+            {
+                int vertexIndex = indices[i];
+                adjacency->triangles[fillCounts[vertexIndex]] = i / 3;
+                fillCounts[vertexIndex]++;
+            }
+        }
+    }
+
+    void MeshOptimizer::OptimizeVertexCache(uint16_t* indices, int indexNum, int vertexNum, int cacheSize)
+    {
+        assert(0 == (indexNum % 3));
+        int triangleNum = indexNum / 3;
+        if (0 == triangleNum)
+        {
+            return;
+        }
+
+        TriangleAdjacency adjacency;
+        BuildTriangleAdjacency(indices, indexNum, vertexNum, &adjacency);
+
+        std::vector<int> liveTriangleCounts(vertexNum);
+        for (int i = 0; i < vertexNum; i++)
+        {
+            liveTriangleCounts[i] = adjacency.offsets[i + 1] - adjacency.offsets[i];
+        }
+
+        std::vector<int> cacheTimeStamps(vertexNum, 0);
+        std::vector<bool> emitted(triangleNum, false);
+        std::vector<int> deadEndStack;
+        std::vector<int> candidates;
+
+        std::vector<uint16_t> outputIndices;
+        outputIndices.reserve(indexNum);
+
+        int timeStamp = cacheSize + 1;
+        int cursor = 0;
+
+        // 次にファンの中心にする頂点を選ぶ
+        auto getNextVertex = [&]() -> int
+        {
+            int bestVertex = -1;
+            int bestPriority = -1;
+            for (int vertexIndex : candidates)
+            {
+                if (0 < liveTriangleCounts[vertexIndex])
+                {
+                    // ファンを出力し終えるまでキャッシュに残っている頂点ほど優先
+                    int priority = 0;
+                    if ((timeStamp - cacheTimeStamps[vertexIndex] + (2 * liveTriangleCounts[vertexIndex])) <= cacheSize)
+                    {
+                        priority = timeStamp - cacheTimeStamps[vertexIndex];
+                    }
+                    if (bestPriority < priority)
+                    {
+                        bestPriority = priority;
+                        bestVertex = vertexIndex;
+                    }
+                }
+            }
+
+            if (-1 != bestVertex)
+            {
+                return bestVertex;
+            }
+
+            // 行き止まり：最近使った頂点から戻る
+            while (!deadEndStack.empty())
+            {
+                int vertexIndex = deadEndStack.back();
+                deadEndStack.pop_back();
+                if (0 < liveTriangleCounts[vertexIndex])
+                {
+                    return vertexIndex;
+                }
+            }
+
+            // 入力順で残っている頂点
+            while (cursor < vertexNum)
+            {
+                int vertexIndex = cursor;
+                cursor++;
+                if (0 < liveTriangleCounts[vertexIndex])
+                {
+                    return vertexIndex;
+                }
+            }
+
+            return -1;
+        };
+
+        int fanningVertex = getNextVertex();
+        while (-1 != fanningVertex)
+        {
+            candidates.clear();
+
+            for (int i = adjacency.offsets[fanningVertex]; i < adjacency.offsets[fanningVertex + 1]; i++)
+            {
+                int triangle = adjacency.triangles[i];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+
+                for (int j = 0; j < 3; j++)
+                {
+                    uint16_t vertexIndex = indices[(triangle * 3) + j];
+                    outputIndices.push_back(vertexIndex);
+                    deadEndStack.push_back(vertexIndex);
+                    candidates.push_back(vertexIndex);
+                    liveTriangleCounts[vertexIndex]--;
+
+                    // キャッシュミス
+                    if (cacheSize < (timeStamp - cacheTimeStamps[vertexIndex]))
+                    {
+                        cacheTimeStamps[vertexIndex] = timeStamp;
+                        timeStamp++;
+                    }
+                }
+
+                emitted[triangle] = true;
+            }
+
+            fanningVertex = getNextVertex();
+        }
+
+        assert((int)outputIndices.size() == indexNum);
+        std::copy(outputIndices.begin(), outputIndices.end(), indices);
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(uint16_t* indices, int indexNum, const float* positions, size_t positionStride, int vertexNum, int cacheSize, float threshold)
+    {
+        assert(0 == (indexNum % 3));
+        int triangleNum = indexNum / 3;
+        if (0 == triangleNum)
+        {
+            return;
+        }
+
+        auto getPosition = [&](int vertexIndex) -> Vector3
+        {
+            const float* position = (const float*)(((const uint8_t*)positions) + (positionStride * vertexIndex));
+            return Vector3(position[0], position[1], position[2]);
+        };
+
+        // 頂点キャッシュ（FIFO）を模擬して、キャッシュが入れ替わる位置でクラスタに分ける
+        // 分けすぎると頂点キャッシュの効率が落ちるので、クラスタ内の ACMR が全体の threshold 倍以下のときだけ分ける
+        float meshACMR;
+        {
+            VertexCacheState state;
+            state.entryNum = cacheSize;
+            state.replacementPolicy = VertexCacheReplacementPolicy::kFIFO;
+            meshACMR = ComputeACMR(indices, indexNum, &state);
+        }
+
+        std::vector<int> clusterOffsets;
+        {
+            std::vector<int> cacheTimeStamps(vertexNum, 0);
+            int timeStamp = cacheSize + 1;
+            int clusterMissNum = 0;
+            int clusterTriangleNum = 0;
+
+            for (int triangle = 0; triangle < triangleNum; triangle++)
+            {
+                int missNum = 0;
+                for (int j = 0; j < 3; j++)
+                {
+                    int vertexIndex = indices[(triangle * 3) + j];
+                    if (cacheSize < (timeStamp - cacheTimeStamps[vertexIndex]))
+                    {
+                        cacheTimeStamps[vertexIndex] = timeStamp;
+                        timeStamp++;
+                        missNum++;
+                    }
+                }
+
+                bool boundary = (0 == triangle);
+                if (!boundary && (3 == missNum))
+                {
+                    boundary = ((float)clusterMissNum <= (threshold * meshACMR * (float)clusterTriangleNum));
+                }
+
+                if (boundary)
+                {
+                    clusterOffsets.push_back(triangle);
+                    clusterMissNum = 0;
+                    clusterTriangleNum = 0;
+                }
+
+                clusterMissNum += missNum;
+                clusterTriangleNum++;
+            }
+            clusterOffsets.push_back(triangleNum);
+        }
+
+        int clusterNum = (int)clusterOffsets.size() - 1;
+        if (clusterNum <= 1)
+        {
+            return;
+        }
+
+        // メッシュ全体の重心
+        Vector3 meshCentroid = Vector3::kZero;
+        {
+            float meshArea = 0.0f;
+            for (int triangle = 0; triangle < triangleNum; triangle++)
+            {
+                Vector3 p0 = getPosition(indices[(triangle * 3) + 0]);
+                Vector3 p1 = getPosition(indices[(triangle * 3) + 1]);
+                Vector3 p2 = getPosition(indices[(triangle * 3) + 2]);
+                float area = (p1 - p0).cross(p2 - p0).getNorm();
+                meshCentroid = meshCentroid + (p0 + p1 + p2) * (area / 3.0f);
+                meshArea += area;
+            }
+            if (0.0f < meshArea)
+            {
+                meshCentroid /= meshArea;
+            }
+        }
+
+        // 外側を向いているクラスタほど手前の面を覆いやすいので先に描く
+        std::vector<float> clusterSortKeys(clusterNum);
+        for (int cluster = 0; cluster < clusterNum; cluster++)
+        {
+            Vector3 clusterCentroid = Vector3::kZero;
+            Vector3 clusterNormal = Vector3::kZero;
+            float clusterArea = 0.0f;
+            for (int triangle = clusterOffsets[cluster]; triangle < clusterOffsets[cluster + 1]; triangle++)
+            {
+                Vector3 p0 = getPosition(indices[(triangle * 3) + 0]);
+                Vector3 p1 = getPosition(indices[(triangle * 3) + 1]);
+                Vector3 p2 = getPosition(indices[(triangle * 3) + 2]);
+                Vector3 normal = (p1 - p0).cross(p2 - p0);// 長さは面積の２倍
+                float area = normal.getNorm();
+                clusterCentroid = clusterCentroid + (p0 + p1 + p2) * (area / 3.0f);
+                clusterNormal = clusterNormal + normal;
+                clusterArea += area;
+            }
+
+            float sortKey = 0.0f;
+            float normalLength = clusterNormal.getNorm();
+            if ((0.0f < clusterArea) && (0.0f < normalLength))
+            {
+                clusterCentroid /= clusterArea;
+                sortKey = (clusterCentroid - meshCentroid).dot(clusterNormal / normalLength);
+            }
+            clusterSortKeys[cluster] = sortKey;
+        }
+
+        std::vector<int> clusterOrder(clusterNum);
+        for (int cluster = 0; cluster < clusterNum; cluster++)
+        {
+            clusterOrder[cluster] = cluster;
+        }
+        std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](int lhs, int rhs) { return clusterSortKeys[rhs] < clusterSortKeys[lhs]; });
+
+        std::vector<uint16_t> outputIndices;
+        outputIndices.reserve(indexNum);
+        for (int cluster : clusterOrder)
+        {
+            const uint16_t* begin = &(indices[clusterOffsets[cluster] * 3]);
+            const uint16_t* end = &(indices[clusterOffsets[cluster + 1] * 3]);
+            outputIndices.insert(outputIndices.end(), begin, end);
+        }
+
+        std::copy(outputIndices.begin(), outputIndices.end(), indices);
+    }
+
+    int MeshOptimizer::OptimizeVertexFetch(uint16_t* indices, int indexNum, int vertexNum, int* remap)
+    {
+        std::fill(remap, remap + vertexNum, -1);
+
+        int usedVertexNum = 0;
+        for (int i = 0; i < indexNum; i++)
+        {
+            int vertexIndex = indices[i];
+            if (-1 == remap[vertexIndex])
+            {
+                remap[vertexIndex] = usedVertexNum;
+                usedVertexNum++;
+            }
+            indices[i] = (uint16_t)remap[vertexIndex];
+        }
+
+        // 参照されない頂点は末尾へ
+        int nextVertexIndex = usedVertexNum;
+        for (int i = 0; i < vertexNum; i++)
+        {
+            if (-1 == remap[i])
+            {
+                remap[i] = nextVertexIndex;
+                nextVertexIndex++;
+            }
+        }
+
+        return usedVertexNum;
+    }
+
+    void MeshOptimizer::RemapVertexBuffer(void* dst, const void* src, int vertexNum, size_t stride, const int* remap)
+    {
+        assert(dst != src);
+        for (int i = 0; i < vertexNum; i++)
+        {
+            std::memcpy(((uint8_t*)dst) + (stride * remap[i]), ((const uint8_t*)src) + (stride * i), stride);
+        }
+    }
+
+    float MeshOptimizer::ComputeACMR(const uint16_t* indices, int indexNum, const VertexCacheState* state)
+    {
+        int triangleNum = indexNum / 3;
+        if (0 == triangleNum)
+        {
+            return 0.0f;
+        }
+
+        // 描画と同じ頂点キャッシュで数える
+        VertexCache vertexCache;
+        vertexCache.configure(state);
+        vertexCache.initializeCache();
+
+        int missNum = 0;
+        for (int i = 0; i < (triangleNum * 3); i += 3)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                int vertexId = indices[i + j];
+                if (nullptr == vertexCache.lookupVertexCache(vertexId))
+                {
+                    vertexCache.getVertexCache(vertexId);
+                    missNum++;
+                }
+            }
+            vertexCache.unlockEntries();
+        }
+
+        return (float)missNum / (float)triangleNum;
+    }
+}
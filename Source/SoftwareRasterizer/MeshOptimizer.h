@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include "State\VertexCacheState.h"
+#include "Core\Types.h"
+#include <cstdint>
+
+// インデックスバッファ（三角形リスト）を描画前に並べ替えるユーティリティ
+// 
+//  1. OptimizeVertexCache : 頂点キャッシュのヒット率が上がる順に三角形を並べ替える（Tipsify）
+//  2. OptimizeOverdraw    : 1. の並びをクラスタに分け、外側を向いたクラスタから描くよう並べ替える
+//  3. OptimizeVertexFetch : 頂点を参照順に並べ替える（頂点バッファは RemapVertexBuffer で並べ替える）
+// 
+//  ref. Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007.
+//
+
+namespace SoftwareRasterizer
+{
+    class MeshOptimizer
+    {
+
+    public:
+
+        static void OptimizeVertexCache(uint16_t* indices, int indexNum, int vertexNum, int cacheSize);
+
+        // positions は float3 の配列（stride はバイト数）
+        static void OptimizeOverdraw(uint16_t* indices, int indexNum, const float* positions, size_t positionStride, int vertexNum, int cacheSize, float threshold = 1.05f);
+
+        // remap[旧インデックス] = 新インデックス、戻り値は参照されている頂点数（参照されない頂点は末尾に回る）
+        static int OptimizeVertexFetch(uint16_t* indices, int indexNum, int vertexNum, int* remap);
+        static void RemapVertexBuffer(void* dst, const void* src, int vertexNum, size_t stride, const int* remap);
+
+        // 三角形あたりの頂点シェーダーの実行回数（Average Cache Miss Ratio）
+        static float ComputeACMR(const uint16_t* indices, int indexNum, const VertexCacheState* state);
+
+    };
+}
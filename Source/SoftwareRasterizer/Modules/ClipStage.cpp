@@ -2,11 +2,10 @@
 #include "..\Modules\InterpolationUnit.h"
 #include <cmath>// abs
 #include <cassert>
+#include <utility>// swap
 
 namespace SoftwareRasterizer
 {
-    const int kClippingPlaneNum = 6;
-
     struct ClippingPlaneParameter
     {
         int vectorComponentIndex;// 0=x, 1=y, 2=z
@@ -41,20 +40,82 @@ namespace SoftwareRasterizer
 #endif
     }
 
+    uint32_t ClipStage::ComputeOutcode(const Vector4& clipCoord)
+    {
+        uint32_t outcode = 0;
+        for (int i = 0; i < kClippingPlaneNum; i++)
+        {
+            if (transformClippingBoundaryCoordinate(clipCoord, &kClipPlaneParameters[i]) < 0.0f)
+            {
+                outcode |= (1u << i);
+            }
+        }
+        return outcode;
+    }
+
+    void ClipStage::ComputeOutcodes(const float (*clipCoords)[kVertexBatchMaxSize], int vertexNum, uint32_t* outcodes)
+    {
+        // transformClippingBoundaryCoordinate を平面ごとに展開したもの（レーン方向にベクトル化できる形）
+        const float* x = clipCoords[0];
+        const float* y = clipCoords[1];
+        const float* z = clipCoords[2];
+        const float* w = clipCoords[3];
+        for (int lane = 0; lane < vertexNum; lane++)
+        {
+            uint32_t outcode = 0;
+            outcode |= ((w[lane] + x[lane]) < 0.0f) ? (1u << 0) : 0u;// left
+            outcode |= ((w[lane] - x[lane]) < 0.0f) ? (1u << 1) : 0u;// right
+            outcode |= ((w[lane] + y[lane]) < 0.0f) ? (1u << 2) : 0u;// bottom
+            outcode |= ((w[lane] - y[lane]) < 0.0f) ? (1u << 3) : 0u;// top
+            outcode |= ((w[lane] + z[lane]) < 0.0f) ? (1u << 4) : 0u;// near
+            outcode |= ((w[lane] - z[lane]) < 0.0f) ? (1u << 5) : 0u;// far
+            outcodes[lane] = outcode;
+        }
+    }
+
     void ClipStage::setPrimitiveType(PrimitiveType primitiveType)
     {
         _primitiveType = primitiveType;
     }
 
-    void ClipStage::clipPrimitive(VertexDataB** vertices, int vertexNum, VertexDataB* clippedVertices, int* clippedVertiexNum) const
+    void ClipStage::clipPrimitive(VertexDataB** vertices, int vertexNum, const VertexDataB** clippedVertices, int* clippedVertiexNum)
 	{
+        _vertexPoolCount = 0;
+
+        uint32_t outcodeOr = 0;
+        uint32_t outcodeAnd = (1u << kClippingPlaneNum) - 1;
+        for (int i = 0; i < vertexNum; i++)
+        {
+            outcodeOr |= vertices[i]->outcode;
+            outcodeAnd &= vertices[i]->outcode;
+        }
+
+        // すべての頂点が同じ平面の外側なら破棄
+        if (0 != outcodeAnd)
+        {
+            *clippedVertiexNum = 0;
+            return;
+        }
+
+        // すべての頂点が内側ならそのまま
+        if (0 == outcodeOr)
+        {
+            for (int i = 0; i < vertexNum; i++)
+            {
+                clippedVertices[i] = vertices[i];
+            }
+            *clippedVertiexNum = vertexNum;
+            return;
+        }
+
+        // どの頂点も外側にない平面ではクリップしない
         switch (_primitiveType)
         {
         case PrimitiveType::kLine:
-            clipPrimitiveLine(vertices, vertexNum, clippedVertices, clippedVertiexNum);
+            clipPrimitiveLine(vertices, vertexNum, outcodeOr, clippedVertices, clippedVertiexNum);
             break;
         case PrimitiveType::kTriangle:
-            clipPrimitiveTriangle(vertices, vertexNum, clippedVertices, clippedVertiexNum);
+            clipPrimitiveTriangle(vertices, vertexNum, outcodeOr, clippedVertices, clippedVertiexNum);
             break;
         default:
             *clippedVertiexNum = 0;
@@ -67,7 +128,15 @@ namespace SoftwareRasterizer
         _varyingIndexState = varyingIndexState;
     }
 
-    void ClipStage::clipPrimitiveLine(VertexDataB** primitiveVertices, int primitiveVertexCount, VertexDataB* clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount) const
+    VertexDataB* ClipStage::allocateIntersectingPoint()
+    {
+        assert(_vertexPoolCount < kClippingVertexPoolMaxNum);
+        VertexDataB* vertex = &(_vertexPool[_vertexPoolCount]);
+        _vertexPoolCount++;
+        return vertex;
+    }
+
+    void ClipStage::clipPrimitiveLine(VertexDataB** primitiveVertices, int primitiveVertexCount, uint32_t planeBits, const VertexDataB** clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount)
     {
         if (primitiveVertexCount != 2)
         {
@@ -76,23 +145,29 @@ namespace SoftwareRasterizer
             return;
         }
 
-        for (int i = 0; i < 2; i++)
-        {
-            clippedPrimitiveVertices[i] = *primitiveVertices[i];
-        }
+        // 端点は参照のまま扱い、クリップされた端点だけ交点に差し替える
+        const VertexDataB* p0 = primitiveVertices[0];
+        const VertexDataB* p1 = primitiveVertices[1];
 
         for (int i = 0; i < kClippingPlaneNum; i++)
         {
+            if (!(planeBits & (1u << i)))
+            {
+                continue;
+            }
+
             // 境界座標系に変換
-            float d0 = transformClippingBoundaryCoordinate(clippedPrimitiveVertices[0].clipCoord, &kClipPlaneParameters[i]);
-            float d1 = transformClippingBoundaryCoordinate(clippedPrimitiveVertices[1].clipCoord, &kClipPlaneParameters[i]);
+            float d0 = transformClippingBoundaryCoordinate(p0->clipCoord, &kClipPlaneParameters[i]);
+            float d1 = transformClippingBoundaryCoordinate(p1->clipCoord, &kClipPlaneParameters[i]);
             if (0.0f < d0)
             {
                 if (d1 < 0.0f)
                 {
                     // d0: indide, d1: outside
                     const float t = d0 / (d0 - d1);
-                    InterpolationUnit::InterpolateLinear(&clippedPrimitiveVertices[1], &clippedPrimitiveVertices[0], &clippedPrimitiveVertices[1], t, _varyingIndexState);
+                    VertexDataB* intersectingPoint = allocateIntersectingPoint();
+                    InterpolationUnit::InterpolateLinear(intersectingPoint, p0, p1, t, _varyingIndexState);
+                    p1 = intersectingPoint;
                 }
                 else
                 {
@@ -103,34 +178,24 @@ namespace SoftwareRasterizer
             {
                 // d0: outside, d1: inside
                 const float t = d0 / (d0 - d1);
-                InterpolationUnit::InterpolateLinear(&clippedPrimitiveVertices[0], &clippedPrimitiveVertices[0], &clippedPrimitiveVertices[1], t, _varyingIndexState);
+                VertexDataB* intersectingPoint = allocateIntersectingPoint();
+                InterpolationUnit::InterpolateLinear(intersectingPoint, p0, p1, t, _varyingIndexState);
+                p0 = intersectingPoint;
             }
             else
             {
                 // d0: outside, d1: outside
+                *clippedPrimitiveVertiexCount = 0;
                 return;
             }
         }
 
+        clippedPrimitiveVertices[0] = p0;
+        clippedPrimitiveVertices[1] = p1;
         *clippedPrimitiveVertiexCount = 2;
-
-#ifndef NDEBUG
-        if (false)
-        {
-            float lazyW = std::abs(clippedPrimitiveVertices[0].clipCoord.w) + 0.00001f;
-            assert(-lazyW <= clippedPrimitiveVertices[0].clipCoord.x && clippedPrimitiveVertices[0].clipCoord.x <= lazyW);
-            assert(-lazyW <= clippedPrimitiveVertices[0].clipCoord.y && clippedPrimitiveVertices[0].clipCoord.y <= lazyW);
-            assert(-lazyW <= clippedPrimitiveVertices[0].clipCoord.z && clippedPrimitiveVertices[0].clipCoord.z <= lazyW);
-
-            lazyW = std::abs(clippedPrimitiveVertices[1].clipCoord.w) + 0.00001f;
-            assert(-lazyW <= clippedPrimitiveVertices[1].clipCoord.x && clippedPrimitiveVertices[1].clipCoord.x <= lazyW);
-            assert(-lazyW <= clippedPrimitiveVertices[1].clipCoord.y && clippedPrimitiveVertices[1].clipCoord.y <= lazyW);
-            assert(-lazyW <= clippedPrimitiveVertices[1].clipCoord.z && clippedPrimitiveVertices[1].clipCoord.z <= lazyW);
-        }
-#endif
     }
 
-    void ClipStage::clipPrimitiveTriangle(VertexDataB** primitiveVertices, int primitiveVertexCount, VertexDataB* clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount) const
+    void ClipStage::clipPrimitiveTriangle(VertexDataB** primitiveVertices, int primitiveVertexCount, uint32_t planeBits, const VertexDataB** clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount)
     {
         // Sutherland-Hodgman algorithm
         // Ivan Sutherland, Gary W. Hodgman: Reentrant Polygon Clipping. Communications of the ACM, vol. 17, pp. 32-42, 1974
@@ -164,6 +229,7 @@ namespace SoftwareRasterizer
         //        done
         //    done
         //
+        // リストは頂点へのポインタで持ち、交点だけを頂点プールに作る
 
         assert(primitiveVertexCount == 3);
         if (primitiveVertexCount != 3)
@@ -172,28 +238,31 @@ namespace SoftwareRasterizer
             return;
         }
 
-        VertexDataB inputList[kClippingPointMaxNum] = {};
+        const VertexDataB* listBuffers[2][kClippingPointMaxNum];
+        const VertexDataB** inputList = listBuffers[0];
         int inputListCount = 0;
 
-        VertexDataB outputList[kClippingPointMaxNum] = {};
+        const VertexDataB** outputList = listBuffers[1];
         int outputListCount = 0;
 
         // List outputList = subjectPolygon;
         for (int i = 0; i < 3; i++)
         {
-            outputList[outputListCount] = *primitiveVertices[i];
+            outputList[outputListCount] = primitiveVertices[i];
             outputListCount++;
         }
 
         //for (Edge clipEdge in clipPolygon) do
         for (int i = 0; i < kClippingPlaneNum; i++)
         {
-            // List inputList = outputList;
-            // outputList.clear();
-            for (int j = 0; j < outputListCount; ++j)
+            if (!(planeBits & (1u << i)))
             {
-                inputList[j] = outputList[j];
+                continue;
             }
+
+            // List inputList = outputList;
+            // outputList.clear();
+            std::swap(inputList, outputList);
             inputListCount = outputListCount;
             outputListCount = 0;
 
@@ -202,17 +271,15 @@ namespace SoftwareRasterizer
             {
                 // Point current_point = inputList[i];
                 // Point prev_point = inputList[(i - 1) % inputList.count];
-                VertexDataB& currentPoint = inputList[j];
-                VertexDataB& prevPoint = inputList[((j - 1) + inputListCount) % inputListCount];// (0 - 1) % n = -1 になるので、 n を足してから余剰を求める
+                const VertexDataB* currentPoint = inputList[j];
+                const VertexDataB* prevPoint = inputList[((j - 1) + inputListCount) % inputListCount];// (0 - 1) % n = -1 になるので、 n を足してから余剰を求める
 
-                VertexDataB& p0 = prevPoint;
-                VertexDataB& p1 = currentPoint;
+                const VertexDataB* p0 = prevPoint;
+                const VertexDataB* p1 = currentPoint;
 
                 // 境界座標系に変換（0 <= d のとき indide）
-                float d0 = transformClippingBoundaryCoordinate(p0.clipCoord, &kClipPlaneParameters[i]);
-                float d1 = transformClippingBoundaryCoordinate(p1.clipCoord, &kClipPlaneParameters[i]);
-
-                VertexDataB intersectingPoint;
+                float d0 = transformClippingBoundaryCoordinate(p0->clipCoord, &kClipPlaneParameters[i]);
+                float d1 = transformClippingBoundaryCoordinate(p1->clipCoord, &kClipPlaneParameters[i]);
 
                 // current_point inside clipEdge
                 if (0.0f <= d1)
@@ -220,16 +287,18 @@ namespace SoftwareRasterizer
                     // prev_point not inside clipEdge
                     if (d0 < 0.0f)
                     {
-                        // Point Intersecting_point = ComputeIntersection(prev_point, current_point, clipEdge)
-                        float t = d1 / (d1 - d0);
-                        InterpolationUnit::InterpolateLinear(&intersectingPoint, &p1, &p0, t, _varyingIndexState);
-
                         // outputList.add(Intersecting_point);
                         if (!(outputListCount < kClippingPointMaxNum))
                         {
                             assert(outputListCount < kClippingPointMaxNum);
                             continue;
                         }
+
+                        // Point Intersecting_point = ComputeIntersection(prev_point, current_point, clipEdge)
+                        float t = d1 / (d1 - d0);
+                        VertexDataB* intersectingPoint = allocateIntersectingPoint();
+                        InterpolationUnit::InterpolateLinear(intersectingPoint, p1, p0, t, _varyingIndexState);
+
                         outputList[outputListCount] = intersectingPoint;
                         outputListCount++;
                     }
@@ -246,16 +315,18 @@ namespace SoftwareRasterizer
                 // prev_point inside clipEdge
                 else if (0.0f <= d0)
                 {
-                    // Point Intersecting_point = ComputeIntersection(prev_point, current_point, clipEdge)
-                    float t = d1 / (d1 - d0);
-                    InterpolationUnit::InterpolateLinear(&intersectingPoint, &p1, &p0, t, _varyingIndexState);
-
                     // outputList.add(Intersecting_point);
                     assert(outputListCount < kClippingPointMaxNum);
                     if (!(outputListCount < kClippingPointMaxNum))
                     {
                         continue;
                     }
+
+                    // Point Intersecting_point = ComputeIntersection(prev_point, current_point, clipEdge)
+                    float t = d1 / (d1 - d0);
+                    VertexDataB* intersectingPoint = allocateIntersectingPoint();
+                    InterpolationUnit::InterpolateLinear(intersectingPoint, p1, p0, t, _varyingIndexState);
+
                     outputList[outputListCount] = intersectingPoint;
                     outputListCount++;
                 }
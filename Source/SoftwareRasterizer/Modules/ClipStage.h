@@ -5,27 +5,43 @@
 
 namespace SoftwareRasterizer
 {
-    const int kClippingPointMaxNum = 7;
+    const int kClippingPlaneNum = 6;
+
+    // 三角形は平面ごとに頂点が最大１つ増える
+    const int kClippingPointMaxNum = 3 + kClippingPlaneNum;
+
+    // 交点の頂点を置く領域（平面ごとに交点は最大２つ）
+    const int kClippingVertexPoolMaxNum = 2 * kClippingPlaneNum;
 
 	class ClipStage
 	{
 
 	public:
 
+        // 外側にあるクリップ平面のビットを求める
+        static uint32_t ComputeOutcode(const Vector4& clipCoord);
+        static void ComputeOutcodes(const float (*clipCoords)[kVertexBatchMaxSize], int vertexNum, uint32_t* outcodes);// clipCoords は [xyzw][lane]
+
         void setPrimitiveType(PrimitiveType primitiveType);
         void setVaryingEnabledBits(const VaryingIndexState* varyingIndexState);
 
-        void clipPrimitive(VertexDataB** vertices, int vertexNum, VertexDataB* clippedVertices, int* clippedVertiexNum) const;
+        // clippedVertices には入力の頂点か交点の頂点へのポインタを返す（交点は次の clipPrimitive まで有効）
+        void clipPrimitive(VertexDataB** vertices, int vertexNum, const VertexDataB** clippedVertices, int* clippedVertiexNum);
 
 	private:
 
-        void clipPrimitiveLine(VertexDataB** primitiveVertices, int primitiveVertexCount, VertexDataB* clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount) const;
-        void clipPrimitiveTriangle(VertexDataB** primitiveVertices, int primitiveVertexCount, VertexDataB* clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount) const;
+        void clipPrimitiveLine(VertexDataB** primitiveVertices, int primitiveVertexCount, uint32_t planeBits, const VertexDataB** clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount);
+        void clipPrimitiveTriangle(VertexDataB** primitiveVertices, int primitiveVertexCount, uint32_t planeBits, const VertexDataB** clippedPrimitiveVertices, int* clippedPrimitiveVertiexCount);
+
+        VertexDataB* allocateIntersectingPoint();
 
 	private:
 
         PrimitiveType _primitiveType;
         const VaryingIndexState* _varyingIndexState;
 
+        VertexDataB _vertexPool[kClippingVertexPoolMaxNum];
+        int _vertexPoolCount = 0;
+
     };
 }
@@ -0,0 +1,26 @@
+﻿#include "ColorTileClear.h"
+#include "TextureOperations.h"
+#include <algorithm>// fill
+
+namespace SoftwareRasterizer
+{
+    void ColorTileClear::configure(int width, int height)
+    {
+        _tileNumX = (width + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        _tileNumY = (height + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+
+        // 内容は不定なので、テクセルをそのまま使う
+        _clearedTiles.assign((size_t)_tileNumX * _tileNumY, 0);
+    }
+
+    void ColorTileClear::clear(const Vector4& color)
+    {
+        _clearColor = color;
+        std::fill(_clearedTiles.begin(), _clearedTiles.end(), (uint8_t)1);
+    }
+
+    void ColorTileClear::initializeTile(Texture2D* colorBuffer, int tileX, int tileY)
+    {
+        TextureOperations::FillTextureTileColor(colorBuffer, tileX, tileY, _clearColor);
+    }
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "..\State\Texture2D.h"
+#include "..\Core\Types.h"
+#include <cstdint>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    // タイル配置のカラーバッファの高速クリア
+    // クリアではタイルに印を付けるだけにして、最初に書き込むときにクリア値で埋める
+    class ColorTileClear
+    {
+
+    public:
+
+        void configure(int width, int height);
+
+        // すべてのタイルをクリア済みにする（テクセルには書き込まない）
+        void clear(const Vector4& color);
+
+        const Vector4& getClearColor() const { return _clearColor; }
+
+        // タイルごとのクリア済みフラグ（ResolveTexture に渡す）
+        const uint8_t* getClearedTiles() const { return _clearedTiles.data(); }
+
+        bool isCleared(int tileX, int tileY) const { return (0 != _clearedTiles[(tileY * _tileNumX) + tileX]); }
+
+        // クリア済みのタイルに書き込む前に、タイルをクリア値で埋める
+        void touchTile(Texture2D* colorBuffer, int tileX, int tileY)
+        {
+            uint8_t* cleared = &(_clearedTiles[(tileY * _tileNumX) + tileX]);
+            if (0 != *cleared)
+            {
+                initializeTile(colorBuffer, tileX, tileY);
+                *cleared = 0;
+            }
+        }
+
+    private:
+
+        void initializeTile(Texture2D* colorBuffer, int tileX, int tileY);
+
+    private:
+
+        std::vector<uint8_t> _clearedTiles;
+        Vector4 _clearColor = Vector4::kZero;
+
+        int _tileNumX = 0;
+        int _tileNumY = 0;
+
+    };
+}
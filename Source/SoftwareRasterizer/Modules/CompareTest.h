@@ -11,6 +11,44 @@ namespace SoftwareRasterizer
 
 		static bool Perform(ComparisonFunc op, float lhs, float rhs);
 
+		// 比較関数をコンパイル時に固定した版（深度の格納値をそのまま比較できるよう型は任意）
+		template<ComparisonFunc Op, class T>
+		static bool Perform(T lhs, T rhs)
+		{
+			if constexpr (ComparisonFunc::kLess == Op)
+			{
+				return (lhs < rhs);
+			}
+			else if constexpr (ComparisonFunc::kEqual == Op)
+			{
+				return (lhs == rhs);
+			}
+			else if constexpr (ComparisonFunc::kLessEqual == Op)
+			{
+				return (lhs <= rhs);
+			}
+			else if constexpr (ComparisonFunc::kGreater == Op)
+			{
+				return (lhs > rhs);
+			}
+			else if constexpr (ComparisonFunc::kNotEqual == Op)
+			{
+				return (lhs != rhs);
+			}
+			else if constexpr (ComparisonFunc::kGreaterEqual == Op)
+			{
+				return (lhs >= rhs);
+			}
+			else if constexpr (ComparisonFunc::kAlways == Op)
+			{
+				return true;
+			}
+			else
+			{
+				return false;// kNever
+			}
+		}
+
 	};
 
 }
\ No newline at end of file
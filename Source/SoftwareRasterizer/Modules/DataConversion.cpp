@@ -16,6 +16,19 @@ namespace SoftwareRasterizer
         return (uint8_t)(((float)0xff) * val01);
     }
 
+    // UNORM16 -> FLOAT32
+    float DataConversionRule::ConvertUnorm16ToFloat32(uint16_t val)
+    {
+        return ((float)val) / (float)0xffff;
+    }
+
+    // FLOAT32 -> UNORM16
+    uint16_t DataConversionRule::ConvertFloat32ToUnorm16(float val)
+    {
+        float val01 = std::clamp(val, 0.0f, 1.0f);
+        return (uint16_t)(((float)0xffff) * val01);
+    }
+
     // UNORM24 -> FLOAT32
     float DataConversionRule::ConvertUnorm24ToFloat32(uint32_t val)
     {
@@ -12,6 +12,9 @@ namespace SoftwareRasterizer
         static float ConvertUnorm8ToFloat32(uint8_t val);
         static uint8_t ConvertFloat32ToUnorm8(float val);
 
+        static float ConvertUnorm16ToFloat32(uint16_t val);
+        static uint16_t ConvertFloat32ToUnorm16(float val);
+
         static float ConvertUnorm24ToFloat32(uint32_t val);
         static uint32_t ConvertFloat32ToUnorm24(float val);
     };
@@ -0,0 +1,90 @@
+﻿#include "DepthTileCompression.h"
+#include "InterpolationUnit.h"
+#include <algorithm>// clamp
+
+namespace SoftwareRasterizer
+{
+    void DepthTileCompression::configure(int width, int height)
+    {
+        _width = width;
+        _height = height;
+        _tileNumX = (width + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        _tileNumY = (height + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+
+        // 内容は不定なので、テクセルをそのまま使う
+        DepthTileHeader header = {};
+        header.mode = DepthTileMode::kRaw;
+        _headers.assign((size_t)_tileNumX * _tileNumY, header);
+        _planes.clear();
+        _pendingTiles.clear();
+    }
+
+    void DepthTileCompression::clear(float depth)
+    {
+        DepthPlane plane = {};
+        plane.depths[0] = depth;
+        plane.depthRangeNearVal = 0.0f;
+        plane.depthRangeInvLength = 1.0f;
+        plane.constant = true;
+
+        _planes.clear();
+        _planes.push_back(plane);
+
+        for (DepthTileHeader& header : _headers)
+        {
+            header.mode = DepthTileMode::kPlane;
+            header.planeIndices[0] = 0;
+            header.planeIndices[1] = 0;
+            header.planeMask = 0;
+        }
+    }
+
+    int DepthTileCompression::addPlane(const DepthPlane& plane)
+    {
+        if (kMaxPlaneNum <= (int)_planes.size())
+        {
+            return -1;
+        }
+
+        _planes.push_back(plane);
+        return (int)_planes.size() - 1;
+    }
+
+    uint32_t DepthTileCompression::beginPrimitive()
+    {
+        _pendingTiles.clear();
+
+        _primitiveStamp++;
+        if (0 == _primitiveStamp)
+        {
+            // 一周したら古い番号を消しておく
+            for (DepthTileHeader& header : _headers)
+            {
+                header.cullStamp = 0;
+            }
+            _primitiveStamp = 1;
+        }
+        return _primitiveStamp;
+    }
+
+    float DepthTileCompression::EvaluatePlane(const DepthPlane& plane, int x, int y)
+    {
+        float depth = plane.depths[0];
+        if (!plane.constant)
+        {
+            // RasterizeStage::getTriangleFragment と同じ式
+            Vector2 p_wndCoord(x + 0.5f, y + 0.5f);
+            BarycentricCoord baryCoord = InterpolationUnit::ComputeBarycentricCoord(plane.wndCoords[0], plane.wndCoords[1], plane.wndCoords[2], plane.sarea, p_wndCoord);
+            depth = InterpolationUnit::InterpolateBarycentric(plane.depths[0], plane.depths[1], plane.depths[2], &baryCoord);
+        }
+
+        return NormalizeDepth(plane, depth);
+    }
+
+    float DepthTileCompression::NormalizeDepth(const DepthPlane& plane, float depth)
+    {
+        // OutputMergerStage::normalizeDepth と同じ式
+        float t = (depth - plane.depthRangeNearVal) * plane.depthRangeInvLength;
+        return std::clamp(t, 0.0f, 1.0f);
+    }
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include "..\State\Texture2D.h"
+#include "..\Core\Types.h"
+#include <cstdint>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    // 深度タイルを表す平面
+    // ラスタライザと同じ重心座標の式で深度を再現できるよう、三角形のウィンドウ座標と深度をそのまま持つ
+    struct DepthPlane
+    {
+        Vector2 wndCoords[3];
+        float depths[3];
+        float sarea;
+        float depthRangeNearVal;    // 書き込んだときの深度範囲の逆変換の係数
+        float depthRangeInvLength;
+        bool constant;              // depths[0] で一定（クリア値）
+    };
+
+    enum class DepthTileMode : uint8_t
+    {
+        kRaw,       // テクセルに深度を格納
+        kPlane,     // １～２枚の平面で表す（テクセルの内容は無効）
+        kPending,   // 深度テストにすべて通る三角形で上書き中（ピクセルごとの深度テストと書き込みを省く）
+    };
+
+    struct DepthTileHeader
+    {
+        DepthTileMode mode;
+        DepthTileMode pendingBaseMode;  // kPending にする前のモード
+        int planeIndices[2];
+        uint64_t planeMask;             // planeIndices[1] を使うテクセル（１枚のときは 0）
+        int pendingPlaneIndex;
+        uint64_t pendingMask;           // kPending の間に書き込まれたテクセル
+        uint32_t cullStamp;             // 処理中の三角形の番号と一致すれば、タイル内はすべて深度テストに失敗する
+    };
+
+    // タイル配置の深度バッファの平面圧縮
+    class DepthTileCompression
+    {
+
+    public:
+
+        static const int kMaxPlaneNum = 1 << 20;
+
+        void configure(int width, int height);
+
+        // すべてのタイルをクリア値の平面にする
+        void clear(float depth);
+
+        int getTileNumX() const { return _tileNumX; }
+        int getTileNumY() const { return _tileNumY; }
+        int getWidth() const { return _width; }
+        int getHeight() const { return _height; }
+
+        DepthTileHeader* getHeader(int tileIndex) { return &(_headers[tileIndex]); }
+        DepthTileHeader* getHeader(int tileX, int tileY) { return &(_headers[(tileY * _tileNumX) + tileX]); }
+        const DepthPlane& getPlane(int planeIndex) const { return _planes[planeIndex]; }
+
+        // 平面がいっぱいのときは -1
+        int addPlane(const DepthPlane& plane);
+
+        // 三角形ごとにタイルのカリングと上書きを記録する
+        uint32_t beginPrimitive();
+        uint32_t getPrimitiveStamp() const { return _primitiveStamp; }
+        void addPendingTile(int tileX, int tileY) { _pendingTiles.push_back((tileY * _tileNumX) + tileX); }
+        const std::vector<int>& getPendingTiles() const { return _pendingTiles; }
+        void clearPendingTiles() { _pendingTiles.clear(); }
+
+        bool isCulled(int x, int y) const
+        {
+            if (x < 0 || _width <= x || y < 0 || _height <= y)
+            {
+                return false;
+            }
+            int tileIndex = ((y >> kTextureTileSizeLog2) * _tileNumX) + (x >> kTextureTileSizeLog2);
+            return (_headers[tileIndex].cullStamp == _primitiveStamp);
+        }
+
+        // 平面の深度を [0,1] で求める（ラスタライザの補間と OutputMergerStage の正規化と同じ式）
+        static float EvaluatePlane(const DepthPlane& plane, int x, int y);
+        static float NormalizeDepth(const DepthPlane& plane, float depth);
+
+    private:
+
+        std::vector<DepthTileHeader> _headers;
+        std::vector<DepthPlane> _planes;
+        std::vector<int> _pendingTiles;
+
+        int _width = 0;
+        int _height = 0;
+        int _tileNumX = 0;
+        int _tileNumY = 0;
+
+        uint32_t _primitiveStamp = 0;
+
+    };
+}
@@ -2,6 +2,7 @@
 
 #include "..\Core\Types.h"
 #include "..\State\VaryingIndexState.h"
+#include <cmath>// lerp
 
 namespace SoftwareRasterizer
 {
@@ -22,10 +23,85 @@ namespace SoftwareRasterizer
 
 	public:
 
+        static float EdgeFunction(const Vector2& a, const Vector2& b, const Vector2& c)
+        {
+            // TODO：完全なエッジ関数
+            // 参考 Juan Pineda 1988 A Parallel Algorithm for Polygon Rasterization. 
+
+            Vector3 ab(b - a, 0.0f);
+            Vector3 ac(c - a, 0.0f);
+            return (ab.cross(ac)).z;
+        }
+
+        // 点 p の重心座標（sarea は sarea(ABC)）
+        static BarycentricCoord ComputeBarycentricCoord(const Vector2& a, const Vector2& b, const Vector2& c, float sarea, const Vector2& p)
+        {
+            BarycentricCoord baryCoord;
+            baryCoord.r1 = EdgeFunction(b, c, p) / sarea;
+            baryCoord.r2 = EdgeFunction(c, a, p) / sarea;
+            baryCoord.r3 = EdgeFunction(a, b, p) / sarea;
+            return baryCoord;
+        }
+
+        static float InterpolateBarycentric(float a, float b, float c, const BarycentricCoord* baryCoord)
+        {
+            return (a * baryCoord->r1) + (b * baryCoord->r2) + (c * baryCoord->r3);
+        }
+
         static void InterpolateLinear(VertexDataB* p, const VertexDataB* a, const VertexDataB* b, float t, const VaryingIndexState* varyingIndexState);
+
+        // VaryingNum は有効な補間変数の数（kDynamicVaryingNum なら varyingIndexState->activeVaryingNum）
+        template<int VaryingNum = kDynamicVaryingNum>
         static void InterpolateLinear(VertexDataD* p, const VertexDataD* a, const VertexDataD* b, float t, const VaryingIndexState* varyingIndexState);
 
+        template<int VaryingNum = kDynamicVaryingNum>
         static void InterpolateBarycentric(VertexDataD* p, const VertexDataD* a, const VertexDataD* b, const VertexDataD* c, const BarycentricCoord* baryCoord, const VaryingIndexState* varyingIndexState);
        
     };
+
+    template<int VaryingNum>
+    void InterpolationUnit::InterpolateLinear(VertexDataD* p, const VertexDataD* a, const VertexDataD* b, float t, const VaryingIndexState* varyingIndexState)
+    {
+        const int varyingNum = (kDynamicVaryingNum == VaryingNum) ? varyingIndexState->activeVaryingNum : VaryingNum;
+
+        p->wndCoord = Vector2(
+            std::lerp(a->wndCoord.x, b->wndCoord.x, t),
+            std::lerp(a->wndCoord.y, b->wndCoord.y, t)
+        );
+        p->depth = std::lerp(a->depth, b->depth, t);
+        p->invW = std::lerp(a->invW, b->invW, t);
+        for (int j = 0; j < varyingNum; j++)
+        {
+            int i = varyingIndexState->activeVaryingIndices[j];
+            const Vector4& av = a->varyingsDividedByW[i];
+            const Vector4& bv = b->varyingsDividedByW[i];
+            p->varyingsDividedByW[i] = Vector4(
+                std::lerp(av.x, bv.x, t),
+                std::lerp(av.y, bv.y, t),
+                std::lerp(av.z, bv.z, t),
+                std::lerp(av.w, bv.w, t)
+            );
+        }
+    }
+
+    template<int VaryingNum>
+    void InterpolationUnit::InterpolateBarycentric(VertexDataD* p, const VertexDataD* a, const VertexDataD* b, const VertexDataD* c, const BarycentricCoord* baryCoord, const VaryingIndexState* varyingIndexState)
+    {
+        const int varyingNum = (kDynamicVaryingNum == VaryingNum) ? varyingIndexState->activeVaryingNum : VaryingNum;
+
+        float r1 = baryCoord->r1;
+        float r2 = baryCoord->r2;
+        float r3 = baryCoord->r3;
+        p->wndCoord = (a->wndCoord * r1) + (b->wndCoord * r2) + (c->wndCoord * r3);
+        p->depth = InterpolateBarycentric(a->depth, b->depth, c->depth, baryCoord);// DepthTileCompression と同じ式
+        p->invW = (a->invW * r1) + (b->invW * r2) + (c->invW * r3);
+        for (int j = 0; j < varyingNum; j++)
+        {
+            int i = varyingIndexState->activeVaryingIndices[j];
+            const Vector4& av = a->varyingsDividedByW[i];
+            const Vector4& bv = b->varyingsDividedByW[i];
+            const Vector4& cv = c->varyingsDividedByW[i];
+            p->varyingsDividedByW[i] = (av * r1) + (bv * r2) + (cv * r3);
+        }
+    }
 }
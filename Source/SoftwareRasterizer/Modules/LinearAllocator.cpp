@@ -0,0 +1,129 @@
+﻿#include "LinearAllocator.h"
+#include <algorithm>// max
+#include <cassert>
+
+namespace SoftwareRasterizer
+{
+    namespace
+    {
+        const size_t kBlockAlignment = 64;
+        const size_t kMinBlockSize = 64 * 1024;
+
+        size_t AlignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    LinearAllocator::LinearAllocator()
+    {
+    }
+
+    LinearAllocator::~LinearAllocator()
+    {
+        releaseBlocks();
+    }
+
+    void LinearAllocator::reserve(size_t size)
+    {
+        if (size <= _capacity)
+        {
+            return;
+        }
+
+        assert(0 == getUsedSize());
+        releaseBlocks();
+        addBlock(size);
+        _blockIndex = 0;
+        _offset = 0;
+    }
+
+    void LinearAllocator::reset()
+    {
+        // ブロックが分かれたら、次からは１つのブロックに収まるようにまとめ直す
+        // 以降は同じ使い方をする限り確保は発生しない
+        if (1 < _blocks.size())
+        {
+            size_t size = _capacity;
+            releaseBlocks();
+            addBlock(size);
+        }
+
+        _blockIndex = 0;
+        _offset = 0;
+    }
+
+    void LinearAllocator::rewind(const Marker& marker)
+    {
+        assert(marker.blockIndex < (int)std::max<size_t>(_blocks.size(), 1));
+        assert((marker.blockIndex < _blockIndex) || (marker.offset <= _offset));
+
+        _blockIndex = marker.blockIndex;
+        _offset = marker.offset;
+    }
+
+    void* LinearAllocator::allocateBytes(size_t size, size_t alignment)
+    {
+        assert(0 != alignment && 0 == (alignment & (alignment - 1)));
+        assert(alignment <= kBlockAlignment);
+
+        // 現在のブロックに入らなければ、次のブロック（なければ新しいブロック）へ
+        while (true)
+        {
+            if (_blockIndex < (int)_blocks.size())
+            {
+                Block* block = &(_blocks[_blockIndex]);
+                size_t offset = AlignUp(_offset, alignment);
+                if (offset + size <= block->size)
+                {
+                    _offset = offset + size;
+                    _peakSize = std::max(_peakSize, getUsedSize());
+                    return block->memory + offset;
+                }
+
+                if (_blockIndex + 1 < (int)_blocks.size())
+                {
+                    _blockIndex++;
+                    _offset = 0;
+                    continue;
+                }
+            }
+
+            addBlock(std::max({ size, _capacity, kMinBlockSize }));
+            _blockIndex = (int)_blocks.size() - 1;
+            _offset = 0;
+        }
+    }
+
+    void LinearAllocator::addBlock(size_t size)
+    {
+        size = AlignUp(std::max(size, kMinBlockSize), kBlockAlignment);
+
+        Block block;
+        block.memory = static_cast<uint8_t*>(::operator new(size, std::align_val_t(kBlockAlignment)));
+        block.size = size;
+        _blocks.push_back(block);
+
+        _capacity += size;
+    }
+
+    void LinearAllocator::releaseBlocks()
+    {
+        for (Block& block : _blocks)
+        {
+            ::operator delete(block.memory, std::align_val_t(kBlockAlignment));
+        }
+        _blocks.clear();
+        _capacity = 0;
+    }
+
+    size_t LinearAllocator::getUsedSize() const
+    {
+        size_t size = _offset;
+        for (int i = 0; i < _blockIndex; i++)
+        {
+            size += _blocks[i].size;
+        }
+        return size;
+    }
+}
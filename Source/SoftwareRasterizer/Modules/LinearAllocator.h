@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>// placement new
+#include <type_traits>
+#include <vector>
+
+namespace SoftwareRasterizer
+{
+    // 描画ごとの一時データ用のリニアアロケータ
+    // 先頭から詰めて確保するだけで、解放は reset() / rewind() でまとめて行う
+    class LinearAllocator
+    {
+
+    public:
+
+        struct Marker
+        {
+            int blockIndex;
+            size_t offset;
+        };
+
+    public:
+
+        LinearAllocator();
+        ~LinearAllocator();
+
+        LinearAllocator(const LinearAllocator&) = delete;
+        LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+        void reserve(size_t size);
+
+        // すべての確保を破棄（O(1)）
+        void reset();
+
+        // マーカー以降の確保を破棄
+        Marker getMarker() const { return { _blockIndex, _offset }; }
+        void rewind(const Marker& marker);
+
+        void* allocateBytes(size_t size, size_t alignment);
+
+        // デストラクタは呼ばれないので、後始末の要らない型に限る
+        template<class T>
+        T* allocate(int num)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "LinearAllocator requires trivially destructible types.");
+            T* objects = static_cast<T*>(allocateBytes(sizeof(T) * (size_t)num, alignof(T)));
+            for (int i = 0; i < num; i++)
+            {
+                new(&(objects[i])) T;
+            }
+            return objects;
+        }
+
+        size_t getCapacity() const { return _capacity; }
+        size_t getPeakSize() const { return _peakSize; }
+
+    private:
+
+        struct Block
+        {
+            uint8_t* memory;
+            size_t size;
+        };
+
+        void addBlock(size_t size);
+        void releaseBlocks();
+        size_t getUsedSize() const;
+
+    private:
+
+        std::vector<Block> _blocks;
+        int _blockIndex = 0;
+        size_t _offset = 0;
+
+        size_t _capacity = 0;
+        size_t _peakSize = 0;
+
+    };
+}
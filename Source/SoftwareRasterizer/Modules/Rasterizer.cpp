@@ -68,7 +68,7 @@ namespace SoftwareRasterizer
 
     Rasterizer::~Rasterizer()
     {
-        delete _raster.scanlines;
+        delete[] _raster.scanlines;
     }
 
     void Rasterizer::setClipRect(int minX, int minY, int maxX, int maxY)
@@ -83,7 +83,7 @@ namespace SoftwareRasterizer
     {
         if (_raster.scanlineNum != scanlineNum)
         {
-            delete _raster.scanlines;
+            delete[] _raster.scanlines;
             _raster.scanlines = new Scanline[scanlineNum];
             _raster.scanlineNum = scanlineNum;
             _raster.minY = 0x7fffffff;
@@ -0,0 +1,76 @@
+﻿#include "TexelCache.h"
+#include "TextureCompression.h"
+#include "TextureOperations.h"
+#include <atomic>
+#include <algorithm>// min
+
+namespace SoftwareRasterizer
+{
+    static_assert(TexelCache::kBlockSize == TextureCompression::kBlockSize, "TexelCache holds one compressed block per entry.");
+
+    static std::atomic<uint32_t> s_texelCacheGeneration(1);
+
+    void TexelCache::InvalidateAll()
+    {
+        s_texelCacheGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t TexelCache::fetch(const Texture2D* texture, const IntVector2& texelCoord)
+    {
+        uint32_t generation = s_texelCacheGeneration.load(std::memory_order_relaxed);
+        if (_generation != generation)
+        {
+            for (Entry& entry : _entries)
+            {
+                entry.textureAddr = nullptr;
+            }
+            _generation = generation;
+        }
+
+        int blockX = texelCoord.x >> kBlockSizeLog2;
+        int blockY = texelCoord.y >> kBlockSizeLog2;
+        int entryIndex = ((blockY & (kEntryNumY - 1)) << kEntryNumXLog2) | (blockX & (kEntryNumX - 1));
+
+        Entry* entry = &(_entries[entryIndex]);
+        if (entry->textureAddr == texture->addr && entry->blockX == blockX && entry->blockY == blockY)
+        {
+            _statistics.hitCount++;
+        }
+        else
+        {
+            _statistics.missCount++;
+            fillEntry(entry, texture, blockX, blockY);
+        }
+
+        int inBlockX = texelCoord.x & (kBlockSize - 1);
+        int inBlockY = texelCoord.y & (kBlockSize - 1);
+        return entry->texels[(inBlockY << kBlockSizeLog2) + inBlockX];
+    }
+
+    void TexelCache::fillEntry(Entry* entry, const Texture2D* texture, int blockX, int blockY)
+    {
+        entry->textureAddr = texture->addr;
+        entry->blockX = blockX;
+        entry->blockY = blockY;
+
+        if (TextureCompression::IsCompressedFormat(texture->format))
+        {
+            size_t blockBytes = TextureCompression::GetBlockBytes(texture->format);
+            uintptr_t block = (uintptr_t)(texture->addr) + ((size_t)texture->widthBytes * blockY) + (blockBytes * blockX);
+            TextureCompression::DecodeBlock(texture->format, (const void*)block, entry->texels);
+            return;
+        }
+
+        // 端のブロックのはみ出した部分は最後のテクセルで埋める（読まれることはない）
+        int baseX = blockX << kBlockSizeLog2;
+        int baseY = blockY << kBlockSizeLog2;
+        for (int y = 0; y < kBlockSize; y++)
+        {
+            for (int x = 0; x < kBlockSize; x++)
+            {
+                IntVector2 coord(std::min(baseX + x, texture->width - 1), std::min(baseY + y, texture->height - 1));
+                entry->texels[(y << kBlockSizeLog2) + x] = TextureOperations::FetchTexelPacked(texture, coord);
+            }
+        }
+    }
+}
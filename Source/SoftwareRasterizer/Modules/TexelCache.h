@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include "..\State\Texture2D.h"
+#include "..\Core\Types.h"
+#include <cstdint>
+
+namespace SoftwareRasterizer
+{
+    struct TexelCacheStatistics
+    {
+        uint64_t hitCount = 0;
+        uint64_t missCount = 0;
+    };
+
+    // テクスチャの４x４テクセルのブロックを RGBA8（メモリ上は R, G, B, A の順）で持つキャッシュ
+    // 圧縮テクスチャは展開したブロックを持つ
+    // 隣り合うブロックが別のエントリに入るよう、ブロック座標の下位ビットで直接マップする
+    class TexelCache
+    {
+
+    public:
+
+        static const int kBlockSizeLog2 = 2;
+        static const int kBlockSize = 1 << kBlockSizeLog2;// 4x4
+        static const int kBlockTexelNum = kBlockSize * kBlockSize;
+
+        static const int kEntryNumXLog2 = 3;
+        static const int kEntryNumYLog2 = 3;
+        static const int kEntryNumX = 1 << kEntryNumXLog2;// 8x8（64 バイト x 64 エントリ）
+        static const int kEntryNumY = 1 << kEntryNumYLog2;
+
+        // テクスチャの内容を書き換えたらすべてのスレッドのキャッシュを無効にする
+        static void InvalidateAll();
+
+        // texelCoord は範囲内であること
+        uint32_t fetch(const Texture2D* texture, const IntVector2& texelCoord);
+
+        const TexelCacheStatistics& getStatistics() const { return _statistics; }
+        void resetStatistics() { _statistics = TexelCacheStatistics(); }
+
+    private:
+
+        struct Entry
+        {
+            const void* textureAddr;
+            int blockX;
+            int blockY;
+            uint32_t texels[kBlockTexelNum];
+        };
+
+        void fillEntry(Entry* entry, const Texture2D* texture, int blockX, int blockY);
+
+    private:
+
+        Entry _entries[kEntryNumX * kEntryNumY] = {};
+        uint32_t _generation = 0;
+
+        TexelCacheStatistics _statistics;
+
+    };
+}
@@ -0,0 +1,426 @@
+﻿#include "TextureCompression.h"
+#include <algorithm>// fill swap
+#include <cassert>
+
+namespace SoftwareRasterizer
+{
+    static uint32_t PackTexel(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+    {
+        return (r << 0) | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    // ブロックの先頭（バイト 0 のビット 0）から順にビットを読む
+    class BlockBitReader
+    {
+
+    public:
+
+        explicit BlockBitReader(const uint8_t* block) : _block(block) {}
+
+        uint32_t read(int bitNum)
+        {
+            uint32_t val = 0;
+            for (int i = 0; i < bitNum; i++)
+            {
+                int bitPos = _bitPos + i;
+                val |= (uint32_t)((_block[bitPos >> 3] >> (bitPos & 7)) & 1) << i;
+            }
+            _bitPos += bitNum;
+            return val;
+        }
+
+    private:
+
+        const uint8_t* _block;
+        int _bitPos = 0;
+
+    };
+
+    int TextureCompression::GetBlockBytes(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::kBC1:
+            return 8;
+        case TextureFormat::kBC3:
+        case TextureFormat::kBC7:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    int TextureCompression::GetWidthBytes(TextureFormat format, int width)
+    {
+        int blockNumX = (width + kBlockSize - 1) >> kBlockSizeLog2;
+        return GetBlockBytes(format) * blockNumX;
+    }
+
+    void TextureCompression::DecodeBlock(TextureFormat format, const void* block, uint32_t* texels)
+    {
+        switch (format)
+        {
+        case TextureFormat::kBC1:
+            DecodeBlockBC1((const uint8_t*)block, texels);
+            break;
+        case TextureFormat::kBC3:
+            DecodeBlockBC3((const uint8_t*)block, texels);
+            break;
+        case TextureFormat::kBC7:
+            DecodeBlockBC7((const uint8_t*)block, texels);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    //
+    // BC1 / BC3
+    //
+
+    // RGB565 を８ビットに広げる（上位ビットを下位に複製）
+    static void ExpandColor565(uint32_t color, uint32_t* rgb)
+    {
+        uint32_t r = (color >> 11) & 0x1f;
+        uint32_t g = (color >> 5) & 0x3f;
+        uint32_t b = (color >> 0) & 0x1f;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // カラーブロック（BC3 では常に４色）
+    static void DecodeColorBlock(const uint8_t* block, uint32_t* texels, bool fourColorOnly)
+    {
+        uint32_t color0 = block[0] | (block[1] << 8);
+        uint32_t color1 = block[2] | (block[3] << 8);
+
+        uint32_t c0[3];
+        uint32_t c1[3];
+        ExpandColor565(color0, c0);
+        ExpandColor565(color1, c1);
+
+        uint32_t palette[4];
+        palette[0] = PackTexel(c0[0], c0[1], c0[2], 255);
+        palette[1] = PackTexel(c1[0], c1[1], c1[2], 255);
+        if (fourColorOnly || color0 > color1)
+        {
+            palette[2] = PackTexel(((2 * c0[0]) + c1[0]) / 3, ((2 * c0[1]) + c1[1]) / 3, ((2 * c0[2]) + c1[2]) / 3, 255);
+            palette[3] = PackTexel((c0[0] + (2 * c1[0])) / 3, (c0[1] + (2 * c1[1])) / 3, (c0[2] + (2 * c1[2])) / 3, 255);
+        }
+        else
+        {
+            // ３色と透明な黒
+            palette[2] = PackTexel((c0[0] + c1[0]) / 2, (c0[1] + c1[1]) / 2, (c0[2] + c1[2]) / 2, 255);
+            palette[3] = PackTexel(0, 0, 0, 0);
+        }
+
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+        for (int i = 0; i < TextureCompression::kBlockTexelNum; i++)
+        {
+            texels[i] = palette[(indices >> (2 * i)) & 3];
+        }
+    }
+
+    void TextureCompression::DecodeBlockBC1(const uint8_t* block, uint32_t* texels)
+    {
+        DecodeColorBlock(block, texels, false);
+    }
+
+    void TextureCompression::DecodeBlockBC3(const uint8_t* block, uint32_t* texels)
+    {
+        // 後半８バイトがカラー、前半８バイトがアルファ
+        DecodeColorBlock(block + 8, texels, true);
+
+        uint32_t alpha0 = block[0];
+        uint32_t alpha1 = block[1];
+
+        uint32_t palette[8];
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        if (alpha0 > alpha1)
+        {
+            for (uint32_t i = 1; i <= 6; i++)
+            {
+                palette[1 + i] = (((7 - i) * alpha0) + (i * alpha1)) / 7;
+            }
+        }
+        else
+        {
+            for (uint32_t i = 1; i <= 4; i++)
+            {
+                palette[1 + i] = (((5 - i) * alpha0) + (i * alpha1)) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            indices |= (uint64_t)block[2 + i] << (8 * i);
+        }
+        for (int i = 0; i < kBlockTexelNum; i++)
+        {
+            uint32_t alpha = palette[(indices >> (3 * i)) & 7];
+            texels[i] = (texels[i] & 0x00ffffffu) | (alpha << 24);
+        }
+    }
+
+    //
+    // BC7
+    //
+
+    struct BC7ModeInfo
+    {
+        int subsetNum;
+        int partitionBits;
+        int rotationBits;
+        int indexSelectionBits;
+        int colorBits;
+        int alphaBits;
+        int endpointPBits;  // 端点ごとの P ビット
+        int sharedPBits;    // サブセットで共有する P ビット
+        int indexBits;
+        int index2Bits;
+    };
+
+    static const BC7ModeInfo kBC7Modes[8] =
+    {
+        { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+        { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+        { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+        { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+        { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+        { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+        { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+        { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    // ２サブセットの分割（ビット i がテクセル i のサブセット）
+    static const uint16_t kBC7Partitions2[64] =
+    {
+        0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+        0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+        0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+        0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+        0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+        0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+        0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+        0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+    };
+
+    // ３サブセットの分割（２ビットずつ）
+    static const uint32_t kBC7Partitions3[64] =
+    {
+        0xaa685050, 0x6a5a5040, 0x5a5a4200, 0x5450a0a8, 0xa5a50000, 0xa0a05050, 0x5555a0a0, 0x5a5a5050,
+        0xaa550000, 0xaa555500, 0xaaaa5500, 0x90909090, 0x94949494, 0xa4a4a4a4, 0xa9a59450, 0x2a0a4250,
+        0xa5945040, 0x0a425054, 0xa5a5a500, 0x55a0a0a0, 0xa8a85454, 0x6a6a4040, 0xa4a45000, 0x1a1a0500,
+        0x0050a4a4, 0xaaa59090, 0x14696914, 0x69691400, 0xa08585a0, 0xaa821414, 0x50a4a450, 0x6a5a0200,
+        0xa9a58000, 0x5090a0a8, 0xa8a09050, 0x24242424, 0x00aa5500, 0x24924924, 0x24499224, 0x50a50a50,
+        0x500aa550, 0xaaaa4444, 0x66660000, 0xa5a0a5a0, 0x50a050a0, 0x69286928, 0x44aaaa44, 0x66666600,
+        0xaa444444, 0x54a854a8, 0x95809580, 0x96969600, 0xa85454a8, 0x80959580, 0xaa141414, 0x96960000,
+        0xaaaa1414, 0xa05050a0, 0xa0a5a5a0, 0x96000000, 0x40804080, 0xa9a8a9a8, 0xaaaaaa44, 0x2a4a5254,
+    };
+
+    // サブセットの先頭のインデックスのテクセル（最上位ビットを省略する）
+    static const uint8_t kBC7Anchors2[64] =
+    {
+        15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+        15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+        15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+         6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+    };
+
+    static const uint8_t kBC7Anchors3Second[64] =
+    {
+         3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+         3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+         8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+         3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    };
+
+    static const uint8_t kBC7Anchors3Third[64] =
+    {
+        15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+        15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+        15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+        15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    };
+
+    static const uint32_t kBC7Weights2[4] = { 0, 21, 43, 64 };
+    static const uint32_t kBC7Weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    static const uint32_t kBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    static uint32_t InterpolateBC7(uint32_t e0, uint32_t e1, uint32_t index, int indexBits)
+    {
+        const uint32_t* weights = (2 == indexBits) ? kBC7Weights2 : ((3 == indexBits) ? kBC7Weights3 : kBC7Weights4);
+        uint32_t w = weights[index];
+        return ((e0 * (64 - w)) + (e1 * w) + 32) >> 6;
+    }
+
+    static int GetBC7Subset(const BC7ModeInfo& info, int partition, int texelIndex)
+    {
+        switch (info.subsetNum)
+        {
+        case 2:
+            return (kBC7Partitions2[partition] >> texelIndex) & 1;
+        case 3:
+            return (kBC7Partitions3[partition] >> (2 * texelIndex)) & 3;
+        default:
+            return 0;
+        }
+    }
+
+    static bool IsBC7Anchor(const BC7ModeInfo& info, int partition, int texelIndex)
+    {
+        if (0 == texelIndex)
+        {
+            return true;
+        }
+        switch (info.subsetNum)
+        {
+        case 2:
+            return (kBC7Anchors2[partition] == texelIndex);
+        case 3:
+            return (kBC7Anchors3Second[partition] == texelIndex) || (kBC7Anchors3Third[partition] == texelIndex);
+        default:
+            return false;
+        }
+    }
+
+    void TextureCompression::DecodeBlockBC7(const uint8_t* block, uint32_t* texels)
+    {
+        // モードは先頭の 1 のビットの位置
+        int mode = 0;
+        while (mode < 8 && 0 == (block[0] & (1 << mode)))
+        {
+            mode++;
+        }
+        if (8 <= mode)
+        {
+            // 予約されたモードは透明な黒
+            std::fill(texels, texels + kBlockTexelNum, 0u);
+            return;
+        }
+
+        const BC7ModeInfo& info = kBC7Modes[mode];
+
+        BlockBitReader reader(block);
+        reader.read(mode + 1);
+
+        int partition = (int)reader.read(info.partitionBits);
+        int rotation = (int)reader.read(info.rotationBits);
+        int indexSelection = (int)reader.read(info.indexSelectionBits);
+
+        // 端点 [サブセット * 2 + 0/1][RGBA]
+        const int endpointNum = info.subsetNum * 2;
+        uint32_t endpoints[6][4];
+        for (int c = 0; c < 3; c++)
+        {
+            for (int e = 0; e < endpointNum; e++)
+            {
+                endpoints[e][c] = reader.read(info.colorBits);
+            }
+        }
+        for (int e = 0; e < endpointNum; e++)
+        {
+            endpoints[e][3] = (0 < info.alphaBits) ? reader.read(info.alphaBits) : 255;
+        }
+
+        uint32_t pBits[6] = {};
+        if (0 < info.endpointPBits)
+        {
+            for (int e = 0; e < endpointNum; e++)
+            {
+                pBits[e] = reader.read(1);
+            }
+        }
+        if (0 < info.sharedPBits)
+        {
+            for (int s = 0; s < info.subsetNum; s++)
+            {
+                pBits[(s * 2) + 0] = pBits[(s * 2) + 1] = reader.read(1);
+            }
+        }
+
+        // P ビットを付けてから８ビットに広げる（上位ビットを下位に複製）
+        bool hasPBits = (0 < info.endpointPBits) || (0 < info.sharedPBits);
+        for (int e = 0; e < endpointNum; e++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                int bitNum = (c < 3) ? info.colorBits : info.alphaBits;
+                if (0 == bitNum)
+                {
+                    continue;
+                }
+
+                uint32_t val = endpoints[e][c];
+                if (hasPBits)
+                {
+                    val = (val << 1) | pBits[e];
+                    bitNum++;
+                }
+                val <<= (8 - bitNum);
+                val |= (val >> bitNum);
+                endpoints[e][c] = val;
+            }
+        }
+
+        uint32_t indices[kBlockTexelNum];
+        for (int i = 0; i < kBlockTexelNum; i++)
+        {
+            int bitNum = IsBC7Anchor(info, partition, i) ? (info.indexBits - 1) : info.indexBits;
+            indices[i] = reader.read(bitNum);
+        }
+
+        uint32_t indices2[kBlockTexelNum] = {};
+        if (0 < info.index2Bits)
+        {
+            for (int i = 0; i < kBlockTexelNum; i++)
+            {
+                int bitNum = (0 == i) ? (info.index2Bits - 1) : info.index2Bits;
+                indices2[i] = reader.read(bitNum);
+            }
+        }
+
+        for (int i = 0; i < kBlockTexelNum; i++)
+        {
+            int subset = GetBC7Subset(info, partition, i);
+            const uint32_t* e0 = endpoints[(subset * 2) + 0];
+            const uint32_t* e1 = endpoints[(subset * 2) + 1];
+
+            // カラーとアルファのインデックス（モード 4 / 5 は別々に持つ）
+            uint32_t colorIndex = indices[i];
+            uint32_t alphaIndex = indices[i];
+            int colorIndexBits = info.indexBits;
+            int alphaIndexBits = info.indexBits;
+            if (0 < info.index2Bits)
+            {
+                alphaIndex = indices2[i];
+                alphaIndexBits = info.index2Bits;
+                if (0 != indexSelection)
+                {
+                    std::swap(colorIndex, alphaIndex);
+                    std::swap(colorIndexBits, alphaIndexBits);
+                }
+            }
+
+            uint32_t rgba[4];
+            rgba[0] = InterpolateBC7(e0[0], e1[0], colorIndex, colorIndexBits);
+            rgba[1] = InterpolateBC7(e0[1], e1[1], colorIndex, colorIndexBits);
+            rgba[2] = InterpolateBC7(e0[2], e1[2], colorIndex, colorIndexBits);
+            rgba[3] = InterpolateBC7(e0[3], e1[3], alphaIndex, alphaIndexBits);
+
+            // 回転したチャンネルをアルファと入れ替えて戻す
+            if (0 < rotation)
+            {
+                std::swap(rgba[rotation - 1], rgba[3]);
+            }
+
+            texels[i] = PackTexel(rgba[0], rgba[1], rgba[2], rgba[3]);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include "..\State\Texture2D.h"
+#include <cstdint>
+
+namespace SoftwareRasterizer
+{
+    // ブロック圧縮（BC1 / BC3 / BC7）の展開
+    // ４x４テクセルのブロックを RGBA8（メモリ上は R, G, B, A の順）の 16 テクセルに展開する
+    class TextureCompression
+    {
+
+    public:
+
+        static const int kBlockSizeLog2 = 2;
+        static const int kBlockSize = 1 << kBlockSizeLog2;// 4x4
+        static const int kBlockTexelNum = kBlockSize * kBlockSize;
+
+        static bool IsCompressedFormat(TextureFormat format) { return (TextureFormat::kR8G8B8A8 != format); }
+
+        // ブロック１個のバイト数
+        static int GetBlockBytes(TextureFormat format);
+
+        // ブロック１行分のバイト数（圧縮テクスチャの widthBytes）
+        static int GetWidthBytes(TextureFormat format, int width);
+
+        static void DecodeBlock(TextureFormat format, const void* block, uint32_t* texels);
+
+        static void DecodeBlockBC1(const uint8_t* block, uint32_t* texels);
+        static void DecodeBlockBC3(const uint8_t* block, uint32_t* texels);
+        static void DecodeBlockBC7(const uint8_t* block, uint32_t* texels);
+
+    };
+}
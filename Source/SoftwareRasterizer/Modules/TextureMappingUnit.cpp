@@ -2,48 +2,137 @@
 #include "TextureOperations.h" 
 #include <cmath>// floor
 #include <algorithm>//clamp
+#include <cassert>
+
+// x64 は SSE2 が必ず使える
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && (2 <= _M_IX86_FP)) || defined(__SSE2__)
+#define SOFTWARE_RASTERIZER_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define SOFTWARE_RASTERIZER_USE_SSE2 0
+#endif
 
 namespace SoftwareRasterizer
 {
+    // テクセルはスレッドごとのキャッシュを通して読む（三角形のクアッドやバッチをまたいで使い回す）
+    static thread_local TexelCache s_texelCache;
+
+    TexelCacheStatistics TextureMappingUnit::GetTexelCacheStatistics()
+    {
+        return s_texelCache.getStatistics();
+    }
+
+    void TextureMappingUnit::ResetTexelCacheStatistics()
+    {
+        s_texelCache.resetStatistics();
+    }
+
+    // テクセル座標を [0, size) に収める
+    // PowerOfTwo ならサイズのマスクで済ませる（負の座標も２の補数のまま折り返せる）
+    template<WrapMode Wrap, bool PowerOfTwo>
+    static int WrapTexelCoord(int coord, int size)
+    {
+        if constexpr (WrapMode::kRepeat == Wrap)
+        {
+            if constexpr (PowerOfTwo)
+            {
+                return coord & (size - 1);
+            }
+            else
+            {
+                int m = coord % size;
+                return (m < 0) ? (m + size) : m;
+            }
+        }
+        else if constexpr (WrapMode::kMirroredRepeat == Wrap)
+        {
+            if constexpr (PowerOfTwo)
+            {
+                // 奇数番目の繰り返しは反転する
+                return (coord & size) ? (~coord & (size - 1)) : (coord & (size - 1));
+            }
+            else
+            {
+                // ２倍の周期で繰り返し、後半を折り返す
+                int period = size * 2;
+                int m = coord % period;
+                m = (m < 0) ? (m + period) : m;
+                return (m < size) ? m : (period - 1 - m);
+            }
+        }
+        else
+        {
+            return std::clamp(coord, 0, size - 1);
+        }
+    }
+
     Vector4 TextureMappingUnit::SamplePoint(const Sampler2D* sampler, const IntVector2& texelCoord)
     {
         int width = sampler->texture->width;
         int height = sampler->texture->height;
 
-        // TODO: wrap mode
         // クランプ
         IntVector2 tmp(
-            std::clamp(texelCoord.x, 0, width - 1),
-            std::clamp(texelCoord.y, 0, height - 1)
+            WrapTexelCoord<WrapMode::kClampToEdge, false>(texelCoord.x, width),
+            WrapTexelCoord<WrapMode::kClampToEdge, false>(texelCoord.y, height)
         );
 
-        return TextureOperations::FetchTexelColor(sampler->texture, tmp);
+        return TextureOperations::UnpackTexelColor(s_texelCache.fetch(sampler->texture, tmp));
     }
 
-    Vector4 TextureMappingUnit::SampleNearestPoint(const Sampler2D* sampler, const Vector2& texcoord)
+    template<WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static Vector4 SampleNearestPoint(const Sampler2D* sampler, const Vector2& texcoord)
     {
-        int width = sampler->texture->width;
-        int height = sampler->texture->height;
+        const Texture2D* texture = sampler->texture;
+        int width = texture->width;
+        int height = texture->height;
 
         IntVector2 texelCoord(
-            (int)std::floor(texcoord.x * width),
-            (int)std::floor(texcoord.y * height)
+            WrapTexelCoord<WrapS, PowerOfTwo>((int)std::floor(texcoord.x * width), width),
+            WrapTexelCoord<WrapT, PowerOfTwo>((int)std::floor(texcoord.y * height), height)
         );
 
-        Vector4 color = SamplePoint(sampler, texelCoord);
-
-        return color;
+        return TextureOperations::UnpackTexelColor(s_texelCache.fetch(texture, texelCoord));
     }
 
-    static Vector4 LerpColor(const Vector4& a, const Vector4& b, float t)
+    template<WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static void SampleNearestPointBatch(const Sampler2D* sampler, const float (*texcoords)[kFragmentBatchSize], uint32_t activeMask, float (*colors)[kFragmentBatchSize])
     {
-        return a + ((b - a) * t);
+        for (int i = 0; i < kFragmentBatchSize; i++)
+        {
+            Vector4 color = Vector4::kZero;
+            if (activeMask & (1u << i))
+            {
+                color = SampleNearestPoint<WrapS, WrapT, PowerOfTwo>(sampler, Vector2(texcoords[0][i], texcoords[1][i]));
+            }
+            colors[0][i] = color.x;
+            colors[1][i] = color.y;
+            colors[2][i] = color.z;
+            colors[3][i] = color.w;
+        }
     }
 
-    Vector4 TextureMappingUnit::SampleBilinearInterpolation(const Sampler2D* sampler, const Vector2& texcoord)
+    // バイリニア補間の４テクセルと 8 ビットの補間割合（0～256）
+    struct BilinearFootprint
     {
-        int width = sampler->texture->width;
-        int height = sampler->texture->height;
+        uint32_t q00;
+        uint32_t q01;
+        uint32_t q10;
+        uint32_t q11;
+        int32_t weightX;
+        int32_t weightY;
+    };
+
+    // 固定小数点の結果を [0,1] に戻す係数
+    // 水平方向の補間（x256）で 1 ビット落とし（/2）、垂直方向の補間（x256）をかけたもの
+    static const float kBilinearResultScale = 1.0f / (255.0f * 256.0f * 128.0f);
+
+    template<WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static void ComputeBilinearFootprint(const Sampler2D* sampler, const Vector2& texcoord, BilinearFootprint* footprint)
+    {
+        const Texture2D* texture = sampler->texture;
+        int width = texture->width;
+        int height = texture->height;
 
         // note.
         //
@@ -85,20 +174,230 @@ namespace SoftwareRasterizer
         float xf = x - xi;
         float yf = y - yi;
 
+        // 小数部は 8 ビットの固定小数点にする
+        footprint->weightX = (int32_t)((xf * 256.0f) + 0.5f);
+        footprint->weightY = (int32_t)((yf * 256.0f) + 0.5f);
+
+        int x0 = WrapTexelCoord<WrapS, PowerOfTwo>(xi + 0, width);
+        int x1 = WrapTexelCoord<WrapS, PowerOfTwo>(xi + 1, width);
+        int y0 = WrapTexelCoord<WrapT, PowerOfTwo>(yi + 0, height);
+        int y1 = WrapTexelCoord<WrapT, PowerOfTwo>(yi + 1, height);
+
         // 補間対象のテクセルを取得
-        Vector4 q00 = SamplePoint(sampler, IntVector2(xi + 0, yi + 0));
-        Vector4 q01 = SamplePoint(sampler, IntVector2(xi + 1, yi + 0));
-        Vector4 q10 = SamplePoint(sampler, IntVector2(xi + 0, yi + 1));
-        Vector4 q11 = SamplePoint(sampler, IntVector2(xi + 1, yi + 1));
+        TexelCache* texelCache = &s_texelCache;
+        footprint->q00 = texelCache->fetch(texture, IntVector2(x0, y0));
+        footprint->q01 = texelCache->fetch(texture, IntVector2(x1, y0));
+        footprint->q10 = texelCache->fetch(texture, IntVector2(x0, y1));
+        footprint->q11 = texelCache->fetch(texture, IntVector2(x1, y1));
+    }
+
+#if SOFTWARE_RASTERIZER_USE_SSE2
+
+    // RGBA8 のまま補間し、チャンネルごとの 32 ビット整数で返す（kBilinearResultScale をかけると [0,1]）
+    static __m128i FilterBilinear(const BilinearFootprint& footprint)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        // 左右のテクセルをチャンネルごとに交互に並べる（r0 r1 g0 g1 b0 b1 a0 a1）
+        __m128i row0 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)footprint.q00), _mm_cvtsi32_si128((int)footprint.q01));
+        __m128i row1 = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)footprint.q10), _mm_cvtsi32_si128((int)footprint.q11));
+        row0 = _mm_unpacklo_epi8(row0, zero);
+        row1 = _mm_unpacklo_epi8(row1, zero);
+
+        // 水平方向に補間（r0 * (256 - wx) + r1 * wx）
+        __m128i weightX = _mm_set1_epi32((footprint.weightX << 16) | (256 - footprint.weightX));
+        __m128i top = _mm_srli_epi32(_mm_madd_epi16(row0, weightX), 1);
+        __m128i bottom = _mm_srli_epi32(_mm_madd_epi16(row1, weightX), 1);
+
+        // 上下を交互に並べて垂直方向に補間（符号付き 16 ビットに収まるよう 1 ビット落としてある）
+        __m128i column = _mm_unpacklo_epi16(_mm_packs_epi32(top, top), _mm_packs_epi32(bottom, bottom));
+        __m128i weightY = _mm_set1_epi32((footprint.weightY << 16) | (256 - footprint.weightY));
+        return _mm_madd_epi16(column, weightY);
+    }
+
+#else
 
-        // 水平方向に補間
-        Vector4 r0 = LerpColor(q00, q01, xf);
-        Vector4 r1 = LerpColor(q10, q11, xf);
+    static void FilterBilinear(const BilinearFootprint& footprint, int32_t* rgba)
+    {
+        // SSE2 版と同じ整数演算
+        for (int c = 0; c < 4; c++)
+        {
+            int shift = 8 * c;
+            int32_t q00 = (footprint.q00 >> shift) & 0xff;
+            int32_t q01 = (footprint.q01 >> shift) & 0xff;
+            int32_t q10 = (footprint.q10 >> shift) & 0xff;
+            int32_t q11 = (footprint.q11 >> shift) & 0xff;
+            int32_t top = ((q00 * (256 - footprint.weightX)) + (q01 * footprint.weightX)) >> 1;
+            int32_t bottom = ((q10 * (256 - footprint.weightX)) + (q11 * footprint.weightX)) >> 1;
+            rgba[c] = (top * (256 - footprint.weightY)) + (bottom * footprint.weightY);
+        }
+    }
+
+#endif
+
+    template<WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static Vector4 SampleBilinearInterpolation(const Sampler2D* sampler, const Vector2& texcoord)
+    {
+        BilinearFootprint footprint;
+        ComputeBilinearFootprint<WrapS, WrapT, PowerOfTwo>(sampler, texcoord, &footprint);
+
+#if SOFTWARE_RASTERIZER_USE_SSE2
+        __m128 color = _mm_mul_ps(_mm_cvtepi32_ps(FilterBilinear(footprint)), _mm_set1_ps(kBilinearResultScale));
+        float rgba[4];
+        _mm_storeu_ps(rgba, color);
+        return Vector4(rgba[0], rgba[1], rgba[2], rgba[3]);
+#else
+        int32_t rgba[4];
+        FilterBilinear(footprint, rgba);
+        return Vector4(rgba[0] * kBilinearResultScale, rgba[1] * kBilinearResultScale, rgba[2] * kBilinearResultScale, rgba[3] * kBilinearResultScale);
+#endif
+    }
+
+    // バッチのレーンをまとめてバイリニア補間する（texcoords は [uv][lane]、colors は [rgba][lane]）
+    // activeMask のビットが立っていないレーンは読まずに 0 を書く
+    template<WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static void SampleBilinearInterpolationBatch(const Sampler2D* sampler, const float (*texcoords)[kFragmentBatchSize], uint32_t activeMask, float (*colors)[kFragmentBatchSize])
+    {
+        static_assert(0 == (kFragmentBatchSize % 4), "kFragmentBatchSize must be a multiple of 4.");
+
+        // ４レーンずつ整数のまま補間し、最後にまとめて float に変換して [rgba][lane] に並べ替える
+        for (int base = 0; base < kFragmentBatchSize; base += 4)
+        {
+#if SOFTWARE_RASTERIZER_USE_SSE2
+            __m128 lanes[4];
+            for (int j = 0; j < 4; j++)
+            {
+                int i = base + j;
+                __m128i filtered = _mm_setzero_si128();
+                if (activeMask & (1u << i))
+                {
+                    BilinearFootprint footprint;
+                    ComputeBilinearFootprint<WrapS, WrapT, PowerOfTwo>(sampler, Vector2(texcoords[0][i], texcoords[1][i]), &footprint);
+                    filtered = FilterBilinear(footprint);
+                }
+                lanes[j] = _mm_cvtepi32_ps(filtered);
+            }
+
+            _MM_TRANSPOSE4_PS(lanes[0], lanes[1], lanes[2], lanes[3]);
+
+            const __m128 scale = _mm_set1_ps(kBilinearResultScale);
+            for (int c = 0; c < 4; c++)
+            {
+                _mm_storeu_ps(&(colors[c][base]), _mm_mul_ps(lanes[c], scale));
+            }
+#else
+            for (int j = 0; j < 4; j++)
+            {
+                int i = base + j;
+                int32_t rgba[4] = {};
+                if (activeMask & (1u << i))
+                {
+                    BilinearFootprint footprint;
+                    ComputeBilinearFootprint<WrapS, WrapT, PowerOfTwo>(sampler, Vector2(texcoords[0][i], texcoords[1][i]), &footprint);
+                    FilterBilinear(footprint, rgba);
+                }
+                for (int c = 0; c < 4; c++)
+                {
+                    colors[c][i] = rgba[c] * kBilinearResultScale;
+                }
+            }
+#endif
+        }
+    }
+
+    template<FilterType Filter, WrapMode WrapS, WrapMode WrapT, bool PowerOfTwo>
+    static void SelectSampleFuncs(SampleTexture2dFunc* func, SampleTexture2dBatchFunc* batchFunc)
+    {
+        if constexpr (FilterType::kPoint == Filter)
+        {
+            *func = SampleNearestPoint<WrapS, WrapT, PowerOfTwo>;
+            *batchFunc = SampleNearestPointBatch<WrapS, WrapT, PowerOfTwo>;
+        }
+        else
+        {
+            *func = SampleBilinearInterpolation<WrapS, WrapT, PowerOfTwo>;
+            *batchFunc = SampleBilinearInterpolationBatch<WrapS, WrapT, PowerOfTwo>;
+        }
+    }
+
+    template<FilterType Filter, WrapMode WrapS, WrapMode WrapT>
+    static void SelectSampleFuncsByPowerOfTwo(bool powerOfTwo, SampleTexture2dFunc* func, SampleTexture2dBatchFunc* batchFunc)
+    {
+        if (powerOfTwo)
+        {
+            SelectSampleFuncs<Filter, WrapS, WrapT, true>(func, batchFunc);
+        }
+        else
+        {
+            SelectSampleFuncs<Filter, WrapS, WrapT, false>(func, batchFunc);
+        }
+    }
+
+    template<FilterType Filter, WrapMode WrapS>
+    static void SelectSampleFuncsByWrapT(WrapMode wrapT, bool powerOfTwo, SampleTexture2dFunc* func, SampleTexture2dBatchFunc* batchFunc)
+    {
+        switch (wrapT)
+        {
+        case WrapMode::kRepeat:
+            SelectSampleFuncsByPowerOfTwo<Filter, WrapS, WrapMode::kRepeat>(powerOfTwo, func, batchFunc);
+            break;
+        case WrapMode::kMirroredRepeat:
+            SelectSampleFuncsByPowerOfTwo<Filter, WrapS, WrapMode::kMirroredRepeat>(powerOfTwo, func, batchFunc);
+            break;
+        case WrapMode::kClampToEdge:
+        default:
+            SelectSampleFuncsByPowerOfTwo<Filter, WrapS, WrapMode::kClampToEdge>(powerOfTwo, func, batchFunc);
+            break;
+        }
+    }
+
+    template<FilterType Filter>
+    static void SelectSampleFuncsByWrapS(WrapMode wrapS, WrapMode wrapT, bool powerOfTwo, SampleTexture2dFunc* func, SampleTexture2dBatchFunc* batchFunc)
+    {
+        switch (wrapS)
+        {
+        case WrapMode::kRepeat:
+            SelectSampleFuncsByWrapT<Filter, WrapMode::kRepeat>(wrapT, powerOfTwo, func, batchFunc);
+            break;
+        case WrapMode::kMirroredRepeat:
+            SelectSampleFuncsByWrapT<Filter, WrapMode::kMirroredRepeat>(wrapT, powerOfTwo, func, batchFunc);
+            break;
+        case WrapMode::kClampToEdge:
+        default:
+            SelectSampleFuncsByWrapT<Filter, WrapMode::kClampToEdge>(wrapT, powerOfTwo, func, batchFunc);
+            break;
+        }
+    }
+
+    static void SelectSampleFuncsByFilter(FilterType filter, WrapMode wrapS, WrapMode wrapT, bool powerOfTwo, SampleTexture2dFunc* func, SampleTexture2dBatchFunc* batchFunc)
+    {
+        switch (filter)
+        {
+        case FilterType::kPoint:
+            SelectSampleFuncsByWrapS<FilterType::kPoint>(wrapS, wrapT, powerOfTwo, func, batchFunc);
+            break;
+        case FilterType::kBilinear:
+        default:
+            SelectSampleFuncsByWrapS<FilterType::kBilinear>(wrapS, wrapT, powerOfTwo, func, batchFunc);
+            break;
+        }
+    }
+
+    static bool IsPowerOfTwo(int value)
+    {
+        return (0 < value) && (0 == (value & (value - 1)));
+    }
+
+    void TextureMappingUnit::CompileSampler(Sampler2D* sampler)
+    {
+        const Texture2D* texture = sampler->texture;
+        assert(texture != nullptr);
 
-        // 垂直方向に補間
-        Vector4 color = LerpColor(r0, r1, yf);
+        // 幅と高さが両方とも２のべき乗ならラップをマスクで行う
+        bool powerOfTwo = IsPowerOfTwo(texture->width) && IsPowerOfTwo(texture->height);
 
-        return color;
+        SelectSampleFuncsByFilter(sampler->magFilter, sampler->wrapS, sampler->wrapT, powerOfTwo, &(sampler->sampleFuncs[0]), &(sampler->sampleBatchFuncs[0]));
+        SelectSampleFuncsByFilter(sampler->minFilter, sampler->wrapS, sampler->wrapT, powerOfTwo, &(sampler->sampleFuncs[1]), &(sampler->sampleBatchFuncs[1]));
     }
 
 }
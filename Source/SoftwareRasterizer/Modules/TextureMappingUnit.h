@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "..\State\Texture2D.h"
+#include "TexelCache.h"
 #include "..\Core\Types.h"
 
 namespace SoftwareRasterizer
@@ -12,14 +13,33 @@ namespace SoftwareRasterizer
         kBilinear,  // GL_LINEAR
     };
 
+    enum class WrapMode
+    {
+        kRepeat,            // GL_REPEAT
+        kMirroredRepeat,    // GL_MIRRORED_REPEAT
+        kClampToEdge,       // GL_CLAMP_TO_EDGE
+        kDefault = kClampToEdge,
+    };
+
+    struct Sampler2D;
+
+    // CompileSampler で選ぶ、フィルタとラップモードを固定したサンプリング関数
+    typedef Vector4 (*SampleTexture2dFunc)(const Sampler2D* sampler, const Vector2& texcoord);
+    typedef void (*SampleTexture2dBatchFunc)(const Sampler2D* sampler, const float (*texcoords)[kFragmentBatchSize], uint32_t activeMask, float (*colors)[kFragmentBatchSize]);
+
     struct Sampler2D
     {
-        const Texture2D* texture;
+        const Texture2D* texture = nullptr;
 
-        FilterType filter;// TODO: 
-        //FilterType minFilter;// GL_TEXTURE_MIN_FILTER
-        //FilterType magFilter;// GL_TEXTURE_MAG_FILTER
+        FilterType minFilter = FilterType::kPoint;// GL_TEXTURE_MIN_FILTER（ミップマップは無い）
+        FilterType magFilter = FilterType::kPoint;// GL_TEXTURE_MAG_FILTER
+        WrapMode wrapS = WrapMode::kDefault;// GL_TEXTURE_WRAP_S
+        WrapMode wrapT = WrapMode::kDefault;// GL_TEXTURE_WRAP_T
+        float lodBias = 0.0f;// GL_TEXTURE_LOD_BIAS（LOD が 0 より大きいと縮小）
 
+        // CompileSampler が設定する（[0] は拡大、[1] は縮小）
+        SampleTexture2dFunc sampleFuncs[2] = {};
+        SampleTexture2dBatchFunc sampleBatchFuncs[2] = {};
     };
 
     class TextureMappingUnit
@@ -27,9 +47,16 @@ namespace SoftwareRasterizer
 
     public:
 
+        // サンプラーの設定とテクスチャのサイズからサンプリング関数を選ぶ（バインド時に一度だけ呼ぶ）
+        // テクスチャやサンプラーの設定を変えたら呼び直す
+        static void CompileSampler(Sampler2D* sampler);
+
+        // テクセル座標を直接読む（texelFetch 相当、範囲外はクランプ）
         static Vector4 SamplePoint(const Sampler2D* sampler, const IntVector2& texelCoord);
-        static Vector4 SampleNearestPoint(const Sampler2D* sampler, const Vector2& texcoord);
-        static Vector4 SampleBilinearInterpolation(const Sampler2D* sampler, const Vector2& texcoord);
+
+        // 呼び出したスレッドのテクセルキャッシュのヒット数とミス数
+        static TexelCacheStatistics GetTexelCacheStatistics();
+        static void ResetTexelCacheStatistics();
 
     };
 
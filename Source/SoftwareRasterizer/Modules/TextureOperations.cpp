@@ -1,8 +1,11 @@
 ﻿#include "TextureOperations.h" 
 #include "DataConversion.h"
+#include "TextureCompression.h"
 #include <cstdint>
-#include <cstring>//memcpy
+#include <cstring>//memcpy memset
 #include <cassert>//assert
+#include <algorithm>//min clamp fill
+#include <iterator>//begin end
 
 namespace SoftwareRasterizer
 {
@@ -28,6 +31,59 @@ namespace SoftwareRasterizer
         uint32_t stencil : 8;
     };
 
+    // 下位ビットを１ビットおきに広げる（Morton 順の x と y を交互に並べる）
+    static size_t SpreadBits(size_t val)
+    {
+        val = (val | (val << 4)) & 0x0f0f;
+        val = (val | (val << 2)) & 0x3333;
+        val = (val | (val << 1)) & 0x5555;
+        return val;
+    }
+
+    // テクセルのバイトオフセット
+    static size_t ComputeTexelOffset(const Texture2D* texture, const IntVector2& texelCoord, size_t texelBytes)
+    {
+        size_t widthBytes = texture->widthBytes;
+
+        if (TextureLayout::kSwizzled == texture->layout)
+        {
+            // ブロックの行 → ブロック → ブロック内の Morton 順
+            size_t blockX = (size_t)texelCoord.x >> kTextureSwizzleBlockSizeLog2;
+            size_t blockY = (size_t)texelCoord.y >> kTextureSwizzleBlockSizeLog2;
+            size_t inBlockX = (size_t)texelCoord.x & (kTextureSwizzleBlockSize - 1);
+            size_t inBlockY = (size_t)texelCoord.y & (kTextureSwizzleBlockSize - 1);
+            size_t texelIndex = (blockX * kTextureSwizzleBlockTexelNum) + (SpreadBits(inBlockY) << 1) + SpreadBits(inBlockX);
+            return (widthBytes * blockY) + (texelBytes * texelIndex);
+        }
+
+        if (TextureLayout::kTiled == texture->layout)
+        {
+            // タイルの行 → タイル → タイル内の行 → タイル内の列
+            size_t tileX = (size_t)texelCoord.x >> kTextureTileSizeLog2;
+            size_t tileY = (size_t)texelCoord.y >> kTextureTileSizeLog2;
+            size_t inTileX = (size_t)texelCoord.x & (kTextureTileSize - 1);
+            size_t inTileY = (size_t)texelCoord.y & (kTextureTileSize - 1);
+            size_t texelIndex = (tileX * kTextureTileTexelNum) + (inTileY << kTextureTileSizeLog2) + inTileX;
+            return (widthBytes * tileY) + (texelBytes * texelIndex);
+        }
+
+        return (widthBytes * texelCoord.y) + (texelBytes * texelCoord.x);
+    }
+
+    // 行（タイル配置ではタイルの行、Morton 順の配置ではブロックの行）の数
+    static size_t GetRowNum(const Texture2D* texture)
+    {
+        if (TextureLayout::kTiled == texture->layout)
+        {
+            return ((size_t)texture->height + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        }
+        if (TextureLayout::kSwizzled == texture->layout)
+        {
+            return ((size_t)texture->height + kTextureSwizzleBlockSize - 1) >> kTextureSwizzleBlockSizeLog2;
+        }
+        return texture->height;
+    }
+
     void TextureOperations::validate(const Texture2D* texture)
     {
         assert(nullptr != texture->addr);
@@ -36,28 +92,22 @@ namespace SoftwareRasterizer
         assert(texture->width <= texture->widthBytes);
     }
 
-    void TextureOperations::FillTextureColor(Texture2D* texture, const Vector4& color)
+    // すべてのテクセルを同じ値で埋める
+    static void FillTexels(Texture2D* texture, const void* texel, size_t texelBytes)
     {
         uintptr_t addr = (uintptr_t)(texture->addr);
-        size_t width = texture->width;
-        size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;// TODO: rename
-        size_t byteCount = 4;// TODO: rename
-
-        ColorB8G8R8A8 texel;
-        texel.b = DataConversionRule::ConvertFloat32ToUnorm8(color.z);
-        texel.g = DataConversionRule::ConvertFloat32ToUnorm8(color.y);
-        texel.r = DataConversionRule::ConvertFloat32ToUnorm8(color.x);
-        texel.a = DataConversionRule::ConvertFloat32ToUnorm8(color.w);
+        size_t widthBytes = texture->widthBytes;
+        size_t width = (TextureLayout::kLinear != texture->layout) ? (widthBytes / texelBytes) : texture->width;// タイルの端も埋める
+        size_t height = GetRowNum(texture);
 
         // １行目
         {
-            uintptr_t src = (uintptr_t)&texel;
+            uintptr_t src = (uintptr_t)texel;
             uintptr_t dst = addr;
             for (int x = 0; x < width; x++)
             {
-                std::memcpy((void*)dst, (const void*)src, byteCount);
-                dst += byteCount;
+                std::memcpy((void*)dst, (const void*)src, texelBytes);
+                dst += texelBytes;
             }
         }
 
@@ -72,50 +122,81 @@ namespace SoftwareRasterizer
             }
         }
     }
-    
-    void TextureOperations::FillTextureDepth(Texture2D* texture, float depth)
+
+    static ColorB8G8R8A8 ConvertColorToTexel(const Vector4& color)
     {
-        uintptr_t addr = (uintptr_t)(texture->addr);
-        size_t width = texture->width;
-        size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;// TODO: rename
-        size_t byteCount = 4;// TODO: rename
+        ColorB8G8R8A8 texel;
+        texel.b = DataConversionRule::ConvertFloat32ToUnorm8(color.z);
+        texel.g = DataConversionRule::ConvertFloat32ToUnorm8(color.y);
+        texel.r = DataConversionRule::ConvertFloat32ToUnorm8(color.x);
+        texel.a = DataConversionRule::ConvertFloat32ToUnorm8(color.w);
+        return texel;
+    }
 
-        uint32_t d24 = DataConversionRule::ConvertFloat32ToUnorm24(depth);
+    void TextureOperations::FillTextureColor(Texture2D* texture, const Vector4& color)
+    {
+        ColorB8G8R8A8 texel = ConvertColorToTexel(color);
 
-        DepthStencilD24S8 texel;
-        texel.depth = d24;
-        texel.stencil = 0;
+        FillTexels(texture, &texel, sizeof(texel));
+    }
 
-        // １行目
+    void TextureOperations::FillTextureTileColor(Texture2D* texture, int tileX, int tileY, const Vector4& color)
+    {
+        ColorB8G8R8A8 texel = ConvertColorToTexel(color);
+
+        ColorB8G8R8A8* dst = (ColorB8G8R8A8*)GetTileAddress(texture, tileX, tileY, sizeof(texel));
+        std::fill(dst, dst + kTextureTileTexelNum, texel);
+    }
+    
+    void TextureOperations::FillTextureDepth(Texture2D* texture, DepthFormat format, float depth)
+    {
+        switch (format)
         {
-            uintptr_t src = (uintptr_t)&texel;
-            uintptr_t dst = addr;
-            for (int x = 0; x < width; x++)
+        case DepthFormat::kD16:
             {
-                std::memcpy((void*)dst, (const void*)src, byteCount);
-                dst += byteCount;
+                uint16_t texel = DataConversionRule::ConvertFloat32ToUnorm16(depth);
+                FillTexels(texture, &texel, sizeof(texel));
             }
-        }
-
-        // 残りの行は１行目をコピー
-        {
-            uintptr_t src = addr;
-            uintptr_t dst = addr + widthBytes;
-            for (int y = 1; y < height; y++)
+            break;
+        case DepthFormat::kD24S8:
             {
-                std::memcpy((void*)dst, (const void*)src, widthBytes);
-                dst += widthBytes;
+                DepthStencilD24S8 texel;
+                texel.depth = DataConversionRule::ConvertFloat32ToUnorm24(depth);
+                texel.stencil = 0;
+                FillTexels(texture, &texel, sizeof(texel));
+            }
+            break;
+        case DepthFormat::kD32F:
+            {
+                float texel = std::clamp(depth, 0.0f, 1.0f);
+                FillTexels(texture, &texel, sizeof(texel));
             }
+            break;
         }
     }
 
+    // 圧縮テクスチャのテクセル（ブロックを毎回展開するので、サンプラーは TexelCache を通す）
+    static uint32_t FetchCompressedTexel(const Texture2D* texture, const IntVector2& texelCoord)
+    {
+        assert(TextureLayout::kLinear == texture->layout);
+
+        int blockX = texelCoord.x >> TextureCompression::kBlockSizeLog2;
+        int blockY = texelCoord.y >> TextureCompression::kBlockSizeLog2;
+        size_t blockBytes = TextureCompression::GetBlockBytes(texture->format);
+        uintptr_t block = (uintptr_t)(texture->addr) + ((size_t)texture->widthBytes * blockY) + (blockBytes * blockX);
+
+        uint32_t texels[TextureCompression::kBlockTexelNum];
+        TextureCompression::DecodeBlock(texture->format, (const void*)block, texels);
+        int inBlockX = texelCoord.x & (TextureCompression::kBlockSize - 1);
+        int inBlockY = texelCoord.y & (TextureCompression::kBlockSize - 1);
+        return texels[(inBlockY << TextureCompression::kBlockSizeLog2) + inBlockX];
+    }
+
     Vector4 TextureOperations::FetchTexelColor(const Texture2D* texture, const IntVector2& texelCoord)
     {
         uintptr_t addr = (uintptr_t)(texture->addr);
         size_t width = texture->width;
         size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;
         size_t texelBytes = 4;
 
         if (texelCoord.x < 0 || width <= texelCoord.x ||
@@ -124,42 +205,66 @@ namespace SoftwareRasterizer
             return Vector4::kZero;
         }
 
-        size_t offset = (widthBytes * texelCoord.y) + (texelBytes * texelCoord.x);
-        uintptr_t src = addr + offset;
+        uint32_t texel;
+        if (TextureCompression::IsCompressedFormat(texture->format))
+        {
+            texel = FetchCompressedTexel(texture, texelCoord);
+        }
+        else
+        {
+            size_t offset = ComputeTexelOffset(texture, texelCoord, texelBytes);
+            uintptr_t src = addr + offset;
+            texel = *(const uint32_t*)src;
+        }
 
-        ColorR8G8B8A8 texel = *(const ColorR8G8B8A8*)src;
+        return UnpackTexelColor(texel);
+    }
 
-        Vector4 color(
-            DataConversionRule::ConvertUnorm8ToFloat32(texel.r),
-            DataConversionRule::ConvertUnorm8ToFloat32(texel.g),
-            DataConversionRule::ConvertUnorm8ToFloat32(texel.b),
-            DataConversionRule::ConvertUnorm8ToFloat32(texel.a)
+    Vector4 TextureOperations::UnpackTexelColor(uint32_t texel)
+    {
+        ColorR8G8B8A8 color;
+        std::memcpy(&color, &texel, sizeof(color));
+
+        return Vector4(
+            DataConversionRule::ConvertUnorm8ToFloat32(color.r),
+            DataConversionRule::ConvertUnorm8ToFloat32(color.g),
+            DataConversionRule::ConvertUnorm8ToFloat32(color.b),
+            DataConversionRule::ConvertUnorm8ToFloat32(color.a)
         );
-
-        return color;
     }
 
-    float TextureOperations::FetchTexelDepth(const Texture2D* texture, const IntVector2& texelCoord)
+    uint32_t TextureOperations::FetchTexelPacked(const Texture2D* texture, const IntVector2& texelCoord)
     {
-        uintptr_t addr = (uintptr_t)(texture->addr);
-        size_t width = texture->width;
-        size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;
-        size_t texelBytes = 4;
+        assert(0 <= texelCoord.x && texelCoord.x < texture->width);
+        assert(0 <= texelCoord.y && texelCoord.y < texture->height);
 
-        if (texelCoord.x < 0 || width <= texelCoord.x ||
-            texelCoord.y < 0 || height <= texelCoord.y)
+        if (TextureCompression::IsCompressedFormat(texture->format))
         {
-            return 0.0f;
+            return FetchCompressedTexel(texture, texelCoord);
         }
 
-        size_t offset = (widthBytes * texelCoord.y) + (texelBytes * texelCoord.x);
-        uintptr_t src = addr + offset;
+        uintptr_t src = (uintptr_t)(texture->addr) + ComputeTexelOffset(texture, texelCoord, sizeof(uint32_t));
+        return *(const uint32_t*)src;
+    }
 
-        DepthStencilD24S8 texel = *(const DepthStencilD24S8*)src;
-        float depth = DataConversionRule::ConvertUnorm24ToFloat32(texel.depth);
-        return depth;
+    float TextureOperations::FetchTexelDepth(const Texture2D* texture, DepthFormat format, const IntVector2& texelCoord)
+    {
+        const void* src = GetTexelAddress(texture, texelCoord, GetDepthTexelBytes(format));
+        if (nullptr == src)
+        {
+            return 0.0f;
+        }
 
+        switch (format)
+        {
+        case DepthFormat::kD16:
+            return DataConversionRule::ConvertUnorm16ToFloat32(*(const uint16_t*)src);
+        case DepthFormat::kD24S8:
+            return DataConversionRule::ConvertUnorm24ToFloat32(((const DepthStencilD24S8*)src)->depth);
+        case DepthFormat::kD32F:
+            return *(const float*)src;
+        }
+        return 0.0f;
     }
 
     void TextureOperations::StoreTexelColor(Texture2D* texture, const IntVector2& texelCoord, const Vector4& color)
@@ -170,7 +275,6 @@ namespace SoftwareRasterizer
         uintptr_t addr = (uintptr_t)(texture->addr);
         size_t width = texture->width;
         size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;
         size_t texelBytes = 4;
 
         if (texelCoord.x < 0 || width <= texelCoord.x ||
@@ -179,40 +283,154 @@ namespace SoftwareRasterizer
             return;
         }
 
-        size_t offset = (widthBytes * texelCoord.y) + (texelBytes * texelCoord.x);
+        size_t offset = ComputeTexelOffset(texture, texelCoord, texelBytes);
         uintptr_t dst = addr + offset;
 
-        ColorB8G8R8A8 texel;
-        texel.b = DataConversionRule::ConvertFloat32ToUnorm8(color.z);
-        texel.g = DataConversionRule::ConvertFloat32ToUnorm8(color.y);
-        texel.r = DataConversionRule::ConvertFloat32ToUnorm8(color.x);
-        texel.a = DataConversionRule::ConvertFloat32ToUnorm8(color.w);
+        *(ColorB8G8R8A8*)dst = ConvertColorToTexel(color);
+    }
+
+    void TextureOperations::StoreTexelDepth(Texture2D* texture, DepthFormat format, const IntVector2& texelCoord, float depth)
+    {
+        void* dst = GetTexelAddress(texture, texelCoord, GetDepthTexelBytes(format));
+        if (nullptr == dst)
+        {
+            return;
+        }
 
-        *(ColorB8G8R8A8*)dst = texel;
+        switch (format)
+        {
+        case DepthFormat::kD16:
+            *(uint16_t*)dst = DataConversionRule::ConvertFloat32ToUnorm16(depth);
+            break;
+        case DepthFormat::kD24S8:
+            ((DepthStencilD24S8*)dst)->depth = DataConversionRule::ConvertFloat32ToUnorm24(depth);
+            break;
+        case DepthFormat::kD32F:
+            *(float*)dst = std::clamp(depth, 0.0f, 1.0f);
+            break;
+        }
     }
 
-    void TextureOperations::StoreTexelDepth(Texture2D* texture, const IntVector2& texelCoord, float depth)
+    int TextureOperations::GetDepthTexelBytes(DepthFormat format)
+    {
+        switch (format)
+        {
+        case DepthFormat::kD16:
+            return sizeof(uint16_t);
+        case DepthFormat::kD24S8:
+            return sizeof(uint32_t);
+        case DepthFormat::kD32F:
+            return sizeof(float);
+        }
+        return 0;
+    }
+
+    void* TextureOperations::GetTexelAddress(const Texture2D* texture, const IntVector2& texelCoord, size_t texelBytes)
     {
-        uintptr_t addr = (uintptr_t)(texture->addr);
         size_t width = texture->width;
         size_t height = texture->height;
-        size_t widthBytes = texture->widthBytes;
-        size_t byteCount = sizeof(uint32_t);// TODO: rename
 
         if (texelCoord.x < 0 || width <= texelCoord.x ||
             texelCoord.y < 0 || height <= texelCoord.y)
         {
-            return;
+            return nullptr;
         }
 
-        size_t offset = (widthBytes * texelCoord.y) + (sizeof(float) * texelCoord.x);
-        uintptr_t dst = addr + offset;
+        uintptr_t addr = (uintptr_t)(texture->addr);
+        return (void*)(addr + ComputeTexelOffset(texture, texelCoord, texelBytes));
+    }
+
+    void* TextureOperations::GetTileAddress(const Texture2D* texture, int tileX, int tileY, size_t texelBytes)
+    {
+        assert(TextureLayout::kTiled == texture->layout);
+
+        uintptr_t addr = (uintptr_t)(texture->addr);
+        size_t offset = ((size_t)texture->widthBytes * tileY) + (texelBytes * kTextureTileTexelNum * tileX);
+        return (void*)(addr + offset);
+    }
+
+    size_t TextureOperations::GetSwizzledTextureBytes(int width, int height)
+    {
+        size_t texelBytes = 4;
+        size_t blockNumX = ((size_t)width + kTextureSwizzleBlockSize - 1) >> kTextureSwizzleBlockSizeLog2;
+        size_t blockNumY = ((size_t)height + kTextureSwizzleBlockSize - 1) >> kTextureSwizzleBlockSizeLog2;
+        return texelBytes * kTextureSwizzleBlockTexelNum * blockNumX * blockNumY;
+    }
+
+    void TextureOperations::SwizzleTexture(const Texture2D* srcTexture, Texture2D* dstTexture)
+    {
+        assert(TextureLayout::kLinear == srcTexture->layout);
+        assert(TextureFormat::kR8G8B8A8 == srcTexture->format);
+        assert(nullptr != dstTexture->addr);
+
+        size_t texelBytes = 4;
+        size_t blockNumX = ((size_t)srcTexture->width + kTextureSwizzleBlockSize - 1) >> kTextureSwizzleBlockSizeLog2;
 
-        DepthStencilD24S8 texel;
-        texel.depth = DataConversionRule::ConvertFloat32ToUnorm24(depth);
-        texel.stencil = 0;
+        dstTexture->width = srcTexture->width;
+        dstTexture->height = srcTexture->height;
+        dstTexture->widthBytes = (int)(texelBytes * kTextureSwizzleBlockTexelNum * blockNumX);
+        dstTexture->layout = TextureLayout::kSwizzled;
+        dstTexture->format = srcTexture->format;
 
-        *(DepthStencilD24S8*)dst = texel;
+        // ブロックの端は 0 で埋めておく
+        std::memset((void*)(dstTexture->addr), 0, GetSwizzledTextureBytes(srcTexture->width, srcTexture->height));
+
+        uintptr_t srcAddr = (uintptr_t)(srcTexture->addr);
+        uintptr_t dstAddr = (uintptr_t)(dstTexture->addr);
+        for (int y = 0; y < srcTexture->height; y++)
+        {
+            for (int x = 0; x < srcTexture->width; x++)
+            {
+                IntVector2 texelCoord(x, y);
+                uintptr_t src = srcAddr + ComputeTexelOffset(srcTexture, texelCoord, texelBytes);
+                uintptr_t dst = dstAddr + ComputeTexelOffset(dstTexture, texelCoord, texelBytes);
+                std::memcpy((void*)dst, (const void*)src, texelBytes);
+            }
+        }
+    }
+
+    void TextureOperations::ResolveTexture(const Texture2D* srcTexture, Texture2D* dstTexture, const uint8_t* clearedTiles, const Vector4& clearColor)
+    {
+        assert(TextureLayout::kTiled == srcTexture->layout);
+        assert(TextureLayout::kLinear == dstTexture->layout);
+
+        uintptr_t srcAddr = (uintptr_t)(srcTexture->addr);
+        uintptr_t dstAddr = (uintptr_t)(dstTexture->addr);
+        size_t width = std::min(srcTexture->width, dstTexture->width);
+        size_t height = std::min(srcTexture->height, dstTexture->height);
+        size_t srcWidthBytes = srcTexture->widthBytes;
+        size_t dstWidthBytes = dstTexture->widthBytes;
+        size_t texelBytes = 4;
+
+        const size_t tileBytes = texelBytes * kTextureTileTexelNum;
+        const size_t tileRowBytes = texelBytes * kTextureTileSize;// タイル内の１行（32 バイト）
+        size_t fullTileNum = width >> kTextureTileSizeLog2;
+        size_t restBytes = texelBytes * (width & (kTextureTileSize - 1));
+        size_t tileNumX = srcWidthBytes / tileBytes;
+
+        // クリア済みのタイルの１行分
+        ColorB8G8R8A8 clearRow[kTextureTileSize];
+        std::fill(std::begin(clearRow), std::end(clearRow), ConvertColorToTexel(clearColor));
+
+        // タイル内の１行はリニア配置でも連続しているので、固定長のコピーで並べ直す
+        for (size_t y = 0; y < height; y++)
+        {
+            uintptr_t src = srcAddr + (srcWidthBytes * (y >> kTextureTileSizeLog2)) + (tileRowBytes * (y & (kTextureTileSize - 1)));
+            uintptr_t dst = dstAddr + (dstWidthBytes * y);
+            const uint8_t* cleared = (nullptr != clearedTiles) ? (clearedTiles + (tileNumX * (y >> kTextureTileSizeLog2))) : nullptr;
+            for (size_t tileX = 0; tileX < fullTileNum; tileX++)
+            {
+                const void* rowSrc = (nullptr != cleared && 0 != cleared[tileX]) ? (const void*)clearRow : (const void*)src;
+                std::memcpy((void*)dst, rowSrc, tileRowBytes);
+                src += tileBytes;
+                dst += tileRowBytes;
+            }
+            if (0 < restBytes)
+            {
+                const void* rowSrc = (nullptr != cleared && 0 != cleared[fullTileNum]) ? (const void*)clearRow : (const void*)src;
+                std::memcpy((void*)dst, rowSrc, restBytes);
+            }
+        }
     }
 
 }
@@ -1,11 +1,45 @@
 ﻿#pragma once
 
 #include "..\State\Texture2D.h"
+#include "..\State\RenderTarget.h"
 #include "..\Core\Types.h"
+#include <cstddef>
+#include <cstdint>
 
 namespace SoftwareRasterizer
 {
 
+	// 深度フォーマットごとの格納値（[0,1] の深度から変換して、そのまま比較する）
+	template<DepthFormat Format>
+	struct DepthFormatTraits;
+
+	template<>
+	struct DepthFormatTraits<DepthFormat::kD16>
+	{
+		typedef uint16_t NativeType;
+		static NativeType Convert(float depth01) { return (NativeType)(((float)0xffff) * depth01); }
+		static NativeType Load(const NativeType* src) { return *src; }
+		static void Store(NativeType* dst, NativeType depth) { *dst = depth; }
+	};
+
+	template<>
+	struct DepthFormatTraits<DepthFormat::kD24S8>
+	{
+		typedef uint32_t NativeType;// 下位 24 ビットが深度、上位 8 ビットがステンシル
+		static NativeType Convert(float depth01) { return (NativeType)(((float)0xffffff) * depth01); }
+		static NativeType Load(const NativeType* src) { return (*src & 0x00ffffffu); }
+		static void Store(NativeType* dst, NativeType depth) { *dst = (*dst & 0xff000000u) | depth; }
+	};
+
+	template<>
+	struct DepthFormatTraits<DepthFormat::kD32F>
+	{
+		typedef float NativeType;
+		static NativeType Convert(float depth01) { return depth01; }
+		static NativeType Load(const NativeType* src) { return *src; }
+		static void Store(NativeType* dst, NativeType depth) { *dst = depth; }
+	};
+
 	class TextureOperations
 	{
 
@@ -14,13 +48,37 @@ namespace SoftwareRasterizer
 		static void validate(const Texture2D* texture);
 
 		static void FillTextureColor(Texture2D* texture, const Vector4& color);
-		static void FillTextureDepth(Texture2D* texture, float depth);
+		static void FillTextureDepth(Texture2D* texture, DepthFormat format, float depth);
+
+		// タイル配置のタイル１枚を埋める
+		static void FillTextureTileColor(Texture2D* texture, int tileX, int tileY, const Vector4& color);
 
 		static Vector4 FetchTexelColor(const Texture2D* texture, const IntVector2& texelCoord);
-		static float FetchTexelDepth(const Texture2D* texture, const IntVector2& texelCoord);
+
+		// RGBA8 のテクセルを変換せずに読む（メモリ上は R, G, B, A の順、texelCoord は範囲内であること）
+		static uint32_t FetchTexelPacked(const Texture2D* texture, const IntVector2& texelCoord);
+		static Vector4 UnpackTexelColor(uint32_t texel);
+		static float FetchTexelDepth(const Texture2D* texture, DepthFormat format, const IntVector2& texelCoord);
 
 		static void StoreTexelColor(Texture2D* texture, const IntVector2& texelCoord, const Vector4& color);
-		static void StoreTexelDepth(Texture2D* texture, const IntVector2& texelCoord, float depth);
+		static void StoreTexelDepth(Texture2D* texture, DepthFormat format, const IntVector2& texelCoord, float depth);
+
+		static int GetDepthTexelBytes(DepthFormat format);
+
+		// テクセルのアドレス（範囲外のときは nullptr）
+		static void* GetTexelAddress(const Texture2D* texture, const IntVector2& texelCoord, size_t texelBytes);
+
+		// タイル配置のタイルの先頭アドレス（タイル内は行ごとに並ぶ）
+		static void* GetTileAddress(const Texture2D* texture, int tileX, int tileY, size_t texelBytes);
+
+		// リニア配置のテクスチャを Morton 順の配置へ並べ替える（テクセルは４バイト）
+		// dstTexture->addr には GetSwizzledTextureBytes のバイト数を確保しておく
+		static size_t GetSwizzledTextureBytes(int width, int height);
+		static void SwizzleTexture(const Texture2D* srcTexture, Texture2D* dstTexture);
+
+		// タイル配置のテクスチャをリニア配置のテクスチャへ書き出す
+		// clearedTiles でフラグが立っているタイルは読まずに clearColor で埋める（nullptr ならすべて読む）
+		static void ResolveTexture(const Texture2D* srcTexture, Texture2D* dstTexture, const uint8_t* clearedTiles = nullptr, const Vector4& clearColor = Vector4::kZero);
 
 	};
 
@@ -1,103 +1,220 @@
 ﻿
 #include "VertexCache.h"
+#include <algorithm>// clamp
+#include <cassert>
 
 namespace SoftwareRasterizer
 {
-	static VertexCacheEntry s_vertexCacheEntry[16];
-    static VertexCacheEntry* s_vertexCacheEntryHead;
-    static VertexCacheEntry* s_vertexCacheEntryTail;
+    VertexCache::VertexCache()
+    {
+        VertexCacheState defaultState;
+        configure(&defaultState);
+    }
 
-    static void AppendEntryHead(VertexCacheEntry* entry)
+    void VertexCache::configure(const VertexCacheState* state)
     {
-        if (nullptr == s_vertexCacheEntryHead)
+        int entryNum = std::clamp(state->entryNum, kVertexCacheMinEntryNum, kVertexCacheMaxEntryNum);
+        _replacementPolicy = state->replacementPolicy;
+
+        if (entryNum == (int)_entries.size())
         {
-            s_vertexCacheEntryHead = entry;
-            s_vertexCacheEntryTail = entry;
+            return;
         }
-        else
+
+        _entries.resize(entryNum);
+
+        // バケット数はエントリ数の２倍以上の２のべき乗
+        int bucketBits = 1;
+        while ((1 << bucketBits) < (2 * entryNum))
         {
-            entry->next = s_vertexCacheEntryHead;
-            s_vertexCacheEntryHead->prev = entry;
-            s_vertexCacheEntryHead = entry;
+            bucketBits++;
         }
+        _buckets.resize((size_t)1 << bucketBits);
+        _bucketShift = 32 - bucketBits;
+
+        initializeCache();
     }
 
-    static void AppendEntryTail(VertexCacheEntry* entry)
+    void VertexCache::initializeCache()
     {
-        if (nullptr == s_vertexCacheEntryHead)
+        std::fill(_buckets.begin(), _buckets.end(), -1);
+
+        _head = -1;
+        _tail = -1;
+        _fifoNext = 0;
+
+        for (int i = 0; i < (int)_entries.size(); i++)
         {
-            s_vertexCacheEntryHead = entry;
-            s_vertexCacheEntryTail = entry;
+            VertexCacheEntry* entry = &(_entries[i]);
+            entry->prev = -1;
+            entry->next = -1;
+            entry->hashNext = -1;
+            entry->enabled = false;
+            entry->vertexId = 0;
+            entry->lockStamp = 0;
+
+            // 末尾に追加
+            if (-1 == _head)
+            {
+                _head = i;
+            }
+            else
+            {
+                entry->prev = _tail;
+                _entries[_tail].next = i;
+            }
+            _tail = i;
+        }
+
+        _lockStamp++;
+    }
+
+    int VertexCache::computeBucketIndex(int vertexId) const
+    {
+        // Fibonacci hashing
+        return (int)(((uint32_t)vertexId * 2654435769u) >> _bucketShift);
+    }
+
+    void VertexCache::appendEntryHead(int index)
+    {
+        VertexCacheEntry* entry = &(_entries[index]);
+        entry->prev = -1;
+        entry->next = _head;
+        if (-1 == _head)
+        {
+            _tail = index;
         }
         else
         {
-            entry->prev = s_vertexCacheEntryTail;
-            s_vertexCacheEntryTail->next = entry;
-            s_vertexCacheEntryTail = entry;
+            _entries[_head].prev = index;
         }
+        _head = index;
     }
 
-    static void RemoveEntry(VertexCacheEntry* entry)
+    void VertexCache::removeEntry(int index)
     {
-        if (nullptr == entry->prev)
+        VertexCacheEntry* entry = &(_entries[index]);
+
+        if (-1 == entry->prev)
         {
-            s_vertexCacheEntryHead = entry->next;
+            _head = entry->next;
         }
         else
         {
-            entry->prev->next = entry->next;
+            _entries[entry->prev].next = entry->next;
         }
 
-        if (nullptr == entry->next)
+        if (-1 == entry->next)
         {
-            s_vertexCacheEntryTail = entry->prev;
+            _tail = entry->prev;
         }
         else
         {
-            entry->next->prev = entry->prev;
+            _entries[entry->next].prev = entry->prev;
         }
 
-        entry->prev = nullptr;
-        entry->next = nullptr;
+        entry->prev = -1;
+        entry->next = -1;
     }
 
-	void VertexCache::InitializeCache()
-	{
-        s_vertexCacheEntryHead = nullptr;
-        s_vertexCacheEntryTail = nullptr;
+    void VertexCache::insertBucket(int index)
+    {
+        VertexCacheEntry* entry = &(_entries[index]);
+        int bucketIndex = computeBucketIndex(entry->vertexId);
+        entry->hashNext = _buckets[bucketIndex];
+        _buckets[bucketIndex] = index;
+    }
 
-        for (int i = 0; i < 16; i++)
+    void VertexCache::removeBucket(int index)
+    {
+        VertexCacheEntry* entry = &(_entries[index]);
+        int* link = &(_buckets[computeBucketIndex(entry->vertexId)]);
+        while (-1 != *link)
         {
-            VertexCacheEntry* entry = &(s_vertexCacheEntry[i]);
-            entry->prev = nullptr;
-            entry->next = nullptr;
-            entry->enabled = false;
-            entry->vertexId = 0;
-            AppendEntryTail(entry);
+            if (*link == index)
+            {
+                *link = entry->hashNext;
+                break;
+            }
+            link = &(_entries[*link].hashNext);
+        }
+        entry->hashNext = -1;
+    }
+
+    int VertexCache::selectVictim()
+    {
+        int entryNum = (int)_entries.size();
+
+        switch (_replacementPolicy)
+        {
+        case VertexCacheReplacementPolicy::kFIFO:
+            for (int i = 0; i < entryNum; i++)
+            {
+                int index = _fifoNext;
+                _fifoNext = (_fifoNext + 1) % entryNum;
+                if (!isLocked(index))
+                {
+                    return index;
+                }
+            }
+            break;
+        case VertexCacheReplacementPolicy::kLRU:
+        default:
+            for (int index = _tail; -1 != index; index = _entries[index].prev)
+            {
+                if (!isLocked(index))
+                {
+                    return index;
+                }
+            }
+            break;
         }
-	}
 
-    VertexCacheEntry* VertexCache::LookupVertexCache(int vertexId)
+        // 全エントリがロックされている
+        assert(false);
+        return _tail;
+    }
+
+    VertexCacheEntry* VertexCache::lookupVertexCache(int vertexId)
     {
-        for (VertexCacheEntry* entry = s_vertexCacheEntryHead; nullptr != entry; entry = entry->next)
+        for (int index = _buckets[computeBucketIndex(vertexId)]; -1 != index; index = _entries[index].hashNext)
         {
-            if (entry->enabled && entry->vertexId == vertexId)
+            VertexCacheEntry* entry = &(_entries[index]);
+            if (entry->vertexId == vertexId)
             {
-                RemoveEntry(entry);
-                AppendEntryHead(entry);
+                if (VertexCacheReplacementPolicy::kLRU == _replacementPolicy)
+                {
+                    removeEntry(index);
+                    appendEntryHead(index);
+                }
+                entry->lockStamp = _lockStamp;
                 return entry;
             }
         }
         return nullptr;
     }
 
-    VertexCacheEntry* VertexCache::GetVertexCache(int vertexId)
+    VertexCacheEntry* VertexCache::getVertexCache(int vertexId)
     {
-        VertexCacheEntry* entry = s_vertexCacheEntryTail;
-        RemoveEntry(entry);
-        AppendEntryHead(entry);
+        int index = selectVictim();
+        VertexCacheEntry* entry = &(_entries[index]);
+
+        if (entry->enabled)
+        {
+            removeBucket(index);
+        }
+
+        if (VertexCacheReplacementPolicy::kLRU == _replacementPolicy)
+        {
+            removeEntry(index);
+            appendEntryHead(index);
+        }
+
         entry->enabled = true;
         entry->vertexId = vertexId;
+        entry->lockStamp = _lockStamp;
+        insertBucket(index);
+
         return entry;
     }
 
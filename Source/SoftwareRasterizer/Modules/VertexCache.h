@@ -1,18 +1,21 @@
 ﻿#pragma once
 
 #include "..\Core\Types.h"
+#include "..\State\VertexCacheState.h"
+#include <vector>
 
 namespace SoftwareRasterizer
 {
     struct VertexCacheEntry // = Vertex URB Entry.
     {
-        VertexCacheEntry* prev;
-        VertexCacheEntry* next;
+        int prev;       // LRU リスト
+        int next;
+        int hashNext;   // 同じバケットの次のエントリ
 
         bool enabled;
         int vertexId;
+        uint32_t lockStamp;
 
-        VertexDataA vertexPreTL;
         VertexDataB vertexPostTL;
     };
 
@@ -21,10 +24,46 @@ namespace SoftwareRasterizer
 
     public:
 
-        static void InitializeCache();
+        VertexCache();
 
-        static VertexCacheEntry* LookupVertexCache(int vertexId);
-        static VertexCacheEntry* GetVertexCache(int vertexId);
+        void configure(const VertexCacheState* state);
+        int getEntryNum() const { return (int)_entries.size(); }
+
+        void initializeCache();
+
+        VertexCacheEntry* lookupVertexCache(int vertexId);
+        VertexCacheEntry* getVertexCache(int vertexId);
+
+        // lookup / get したエントリは unlockEntries() まで追い出されない
+        void unlockEntries() { _lockStamp++; }
+
+    private:
+
+        int computeBucketIndex(int vertexId) const;
+
+        void appendEntryHead(int index);
+        void removeEntry(int index);
+
+        void insertBucket(int index);
+        void removeBucket(int index);
+
+        int selectVictim();
+
+        bool isLocked(int index) const { return _entries[index].lockStamp == _lockStamp; }
+
+    private:
+
+        VertexCacheReplacementPolicy _replacementPolicy = VertexCacheReplacementPolicy::kDefault;
+
+        std::vector<VertexCacheEntry> _entries;
+        std::vector<int> _buckets;
+        int _bucketShift = 0;
+
+        int _head = -1;// LRU: 最近使ったエントリ
+        int _tail = -1;// LRU: 最も使われていないエントリ
+        int _fifoNext = 0;// FIFO: 次に置き換えるエントリ
+
+        uint32_t _lockStamp = 1;
 
     };
 }
@@ -3,7 +3,7 @@
 
 namespace SoftwareRasterizer
 {
-    void VertexFetchUnit::FetchVertex(const InputLayout* inputLayout, const VertexBuffers* vertexBuffers, int vertexIndex, VertexDataA* vertex)
+    void VertexFetchUnit::FetchVertex(const InputLayout* inputLayout, const VertexBuffers* vertexBuffers, int vertexIndex, int instanceId, VertexDataA* vertex)
 	{
         // Vertex Element Loop
 
@@ -20,8 +20,11 @@ namespace SoftwareRasterizer
 
                 Vector4 attribute = Vector4::kZero;
 
+                // インスタンスごとの属性は divisor インスタンスごとに進める
+                int elementIndex = (0 == inputElement->divisor) ? vertexIndex : (instanceId / inputElement->divisor);
+
                 // 指定個数のコンポーネントを読み取る
-                uintptr_t ptr = ((uintptr_t)vertexBuffer->addr) + (inputElement->stride * vertexIndex);
+                uintptr_t ptr = ((uintptr_t)vertexBuffer->addr) + (inputElement->stride * elementIndex);
                 switch (inputElement->type)
                 {
                 case ComponentDataType::kFloat:
@@ -11,7 +11,7 @@ namespace SoftwareRasterizer
 
 	public: 
 
-		static void FetchVertex(const InputLayout* inputLayout, const VertexBuffers* vertexBuffers, int vertexIndex, VertexDataA* vertex);
+		static void FetchVertex(const InputLayout* inputLayout, const VertexBuffers* vertexBuffers, int vertexIndex, int instanceId, VertexDataA* vertex);
 
 	};
 }
@@ -39,4 +39,33 @@ namespace SoftwareRasterizer
         outputPixel->color = fragmentShaderOutput.fragColor;
         outputPixel->depth = inputFragment->depth;
     }
+
+    void FragmentShaderStage::executeBatch()
+    {
+        assert(_fragmentShaderProgram->fragmentBatchShaderMain);
+
+        int fragmentNum = _fragmentBatch->fragmentNum;
+        assert(0 < fragmentNum && fragmentNum <= kFragmentBatchSize);
+
+        FragmentBatchShaderInput fragmentShaderInput;
+        fragmentShaderInput.uniformBlock = _constantBuffer->uniformBlock;
+        fragmentShaderInput.activeMask = (1u << fragmentNum) - 1;// 前詰めなので下位ビットから有効
+        fragmentShaderInput.fragCoord = _fragmentBatch->fragCoord;
+        fragmentShaderInput.varyings = _fragmentBatch->varyings;
+
+        FragmentBatchShaderOutput fragmentShaderOutput;
+        _fragmentShaderProgram->fragmentBatchShaderMain(&fragmentShaderInput, &fragmentShaderOutput);
+
+        for (int c = 0; c < 4; c++)
+        {
+            for (int i = 0; i < kFragmentBatchSize; i++)
+            {
+                _pixelBatch->color[c][i] = fragmentShaderOutput.fragColor[c][i];
+            }
+        }
+        for (int i = 0; i < kFragmentBatchSize; i++)
+        {
+            _pixelBatch->depth[i] = _fragmentBatch->fragCoord[2][i];
+        }
+    }
 }
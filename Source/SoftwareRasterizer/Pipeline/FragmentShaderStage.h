@@ -19,10 +19,13 @@ namespace SoftwareRasterizer
         void input(const ConstantBuffer* constantBuffer) { _constantBuffer = constantBuffer; }
         void input(const FragmentShaderProgram* fragmentShaderProgram) { _fragmentShaderProgram = fragmentShaderProgram; }
         void input(const SubspanData* quadFragment) { _quadFragment = quadFragment; }
+        void input(const FragmentBatchData* fragmentBatch) { _fragmentBatch = fragmentBatch; }
 
         void output(QuadPixelData* quadPixelData) { _quadPixelData = quadPixelData; }
+        void output(PixelBatchData* pixelBatch) { _pixelBatch = pixelBatch; }
 
         void execute();
+        void executeBatch();
 
     private:
 
@@ -34,9 +37,11 @@ namespace SoftwareRasterizer
         const ConstantBuffer* _constantBuffer;
         const FragmentShaderProgram* _fragmentShaderProgram;
         const SubspanData* _quadFragment;
+        const FragmentBatchData* _fragmentBatch = nullptr;
 
         // output
         QuadPixelData* _quadPixelData;
+        PixelBatchData* _pixelBatch = nullptr;
 
     };
 }
@@ -2,9 +2,23 @@
 #include "..\RenderingContext.h"
 #include "..\Modules\VertexFetchUnit.h"
 #include "..\Modules\VertexCache.h"
+#include <algorithm>// min, max, clamp, sort, unique, lower_bound
+#include <climits>// INT_MAX
+#include <thread>
+#include <vector>
 
 namespace SoftwareRasterizer
 {
+    namespace
+    {
+        // これより少ない頂点数ではスレッドを増やさない（起動コストの方が大きい）
+        const int kPreTransformThreadMinVertexNum = 256;
+
+        // 事前変換はこのインデックス数ごとに区切って処理する（ライン、三角形のどちらでも割り切れる数）
+        // 変換済み頂点のバッファもこの頂点数までに抑える
+        const int kPreTransformChunkIndexNum = 2 * 3 * 8192;
+    }
+
     void InputAssemblyStage::validateState(const InputLayout* state)
     {
     }
@@ -19,13 +33,19 @@ namespace SoftwareRasterizer
 
     void InputAssemblyStage::prepareReadPrimitive()
     {
+        _primitiveTopologyType = _drawParam->primitiveTopologyType;
+
         switch (_primitiveTopologyType)
         {
         case PrimitiveTopologyType::kLineList:
+        case PrimitiveTopologyType::kLineStrip:
+        case PrimitiveTopologyType::kLineLoop:
             _primitiveType = PrimitiveType::kLine;
             _primitiveVertexNum = 2;
             break;
         case PrimitiveTopologyType::kTriangleList:
+        case PrimitiveTopologyType::kTriangleStrip:
+        case PrimitiveTopologyType::kTriangleFan:
             _primitiveType = PrimitiveType::kTriangle;
             _primitiveVertexNum = 3;
             break;
@@ -36,27 +56,107 @@ namespace SoftwareRasterizer
         }
 
         _readVertexCount = 0;
+
+        _stripVertexCount = 0;
+        _stripFirstVertex = nullptr;
+        _stripPrevVertices[0] = nullptr;
+        _stripPrevVertices[1] = nullptr;
+    }
+
+    bool InputAssemblyStage::isListTopology() const
+    {
+        return (PrimitiveTopologyType::kLineList == _primitiveTopologyType) || (PrimitiveTopologyType::kTriangleList == _primitiveTopologyType);
+    }
+
+    // 描画範囲の i 番目のインデックス（非インデックス描画では頂点番号そのもの）
+    uint32_t InputAssemblyStage::readIndex(int i) const
+    {
+        int position = _drawParam->first + i;
+
+        if (!_drawParam->indexed)
+        {
+            return (uint32_t)position;
+        }
+
+        switch (_indexBuffer->indexType)
+        {
+        case IndexType::kUnsignedInt:
+            return ((const uint32_t*)_indexBuffer->indices)[position];
+        case IndexType::kUnsignedShort:
+        default:
+            return ((const uint16_t*)_indexBuffer->indices)[position];
+        }
+    }
+
+    bool InputAssemblyStage::isPrimitiveRestartIndex(uint32_t index) const
+    {
+        if (!_drawParam->indexed || !_indexBuffer->primitiveRestartEnabled)
+        {
+            return false;
+        }
+
+        uint32_t restartIndex = (IndexType::kUnsignedInt == _indexBuffer->indexType) ? kPrimitiveRestartIndex32 : kPrimitiveRestartIndex16;
+        return (restartIndex == index);
+    }
+
+    int InputAssemblyStage::toVertexIndex(uint32_t index) const
+    {
+        return (int)index + _drawParam->baseVertex;
     }
 
     void InputAssemblyStage::executeVertexLoop()
     {
+        for (int instanceId = 0; instanceId < _drawParam->instanceCount; instanceId++)
+        {
+            // 変換後の頂点はインスタンスごとに異なるので、インスタンスをまたいで共有しない
+            if (0 < instanceId)
+            {
+                _vertexCache->initializeCache();
+                prepareReadPrimitive();
+            }
+
+            _instanceId = instanceId;
+            executeInstanceLoop();
+        }
+    }
+
+    void InputAssemblyStage::executeInstanceLoop()
+    {
+        if (VertexProcessingMode::kPreTransform == _vertexProcessingState->vertexProcessingMode)
+        {
+            executePreTransformLoop();
+            return;
+        }
+
+        if (!isListTopology())
+        {
+            executeVertexStripLoop();
+            return;
+        }
+
+        if (_vertexShaderProgram->vertexBatchShaderMain)
+        {
+            executeVertexBatchLoop();
+            return;
+        }
+
         for (;;)
         {
-            int remainingVertexCount = _indexBuffer->indexNum - _readVertexCount;
+            int remainingVertexCount = _drawParam->count - _readVertexCount;
             if (remainingVertexCount < _primitiveVertexNum)
             {
                 return;
             }
 
-            uint16_t vertexIndices[3];
+            int vertexIndices[3];
             for (int i = 0; i < _primitiveVertexNum; i++)
             {
-                uint16_t vertexIndex = _indexBuffer->indices[_readVertexCount];
+                int vertexIndex = toVertexIndex(readIndex(_readVertexCount));
                 _readVertexCount++;
                 vertexIndices[i] = vertexIndex;
             }
 
-            VertexCacheEntry* entries[3];
+            VertexDataB* vertices[3];
             for (int i = 0; i < _primitiveVertexNum; i++)
             {
                 int vertexIndex = vertexIndices[i];
@@ -65,23 +165,482 @@ namespace SoftwareRasterizer
                 int vertexId = vertexIndex;
 
                 // cache lookup
-                VertexCacheEntry* entry = VertexCache::LookupVertexCache(vertexId);
+                VertexCacheEntry* entry = _vertexCache->lookupVertexCache(vertexId);
                 bool miss = (nullptr == entry);
                 if (miss)
                 {
-                    entry = VertexCache::GetVertexCache(vertexId);
+                    entry = _vertexCache->getVertexCache(vertexId);
+
+                    VertexDataA vertex;
+                    vertex.vertexId = vertexId;
+                    vertex.instanceId = _instanceId;
+                    VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, _instanceId, &vertex);
+
+                    _renderingContext->outputVertex(&vertex, &(entry->vertexPostTL));
+                }
+
+                vertices[i] = &(entry->vertexPostTL);
+            }
+
+            _renderingContext->outputPrimitive(_primitiveType, vertices, _primitiveVertexNum);
+
+            _vertexCache->unlockEntries();
+        }
+    }
+
+    // キャッシュミスした頂点をまとめてからバッチで頂点シェーダーを実行する
+    void InputAssemblyStage::executeVertexBatchLoop()
+    {
+        // グループ内で参照した頂点はロックされて追い出されないので、
+        // グループの頂点数をキャッシュの容量以下に抑える
+        const int groupVertexMaxNum = std::min(_vertexCache->getEntryNum(), kVertexBatchMaxSize);
+        const int groupPrimitiveMaxNum = groupVertexMaxNum / _primitiveVertexNum;
+        if (0 == groupPrimitiveMaxNum)
+        {
+            return;
+        }
+
+        VertexDataB* vertices[kVertexBatchMaxSize];
+        const VertexDataA* missVertexPreTLs[kVertexBatchMaxSize];
+        VertexDataB* missVertexPostTLs[kVertexBatchMaxSize];
+
+        for (;;)
+        {
+            int groupPrimitiveNum = 0;
+            int missNum = 0;
+
+            // プリミティブを集めながらキャッシュミスした頂点をフェッチ
+            while (groupPrimitiveNum < groupPrimitiveMaxNum)
+            {
+                int remainingVertexCount = _drawParam->count - _readVertexCount;
+                if (remainingVertexCount < _primitiveVertexNum)
+                {
+                    break;
+                }
+
+                for (int i = 0; i < _primitiveVertexNum; i++)
+                {
+                    int vertexIndex = toVertexIndex(readIndex(_readVertexCount));
+                    _readVertexCount++;
+
+                    // gen vertex id.
+                    int vertexId = vertexIndex;
+
+                    // cache lookup
+                    VertexCacheEntry* entry = _vertexCache->lookupVertexCache(vertexId);
+                    bool miss = (nullptr == entry);
+                    if (miss)
+                    {
+                        entry = _vertexCache->getVertexCache(vertexId);
+
+                        VertexDataA* vertex = &(_vertexPreTLs[missNum]);
+                        vertex->vertexId = vertexId;
+                        vertex->instanceId = _instanceId;
+                        VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, _instanceId, vertex);
+
+                        missVertexPreTLs[missNum] = vertex;
+                        missVertexPostTLs[missNum] = &(entry->vertexPostTL);
+                        missNum++;
+                    }
+
+                    vertices[(groupPrimitiveNum * _primitiveVertexNum) + i] = &(entry->vertexPostTL);
+                }
+
+                groupPrimitiveNum++;
+            }
+
+            if (0 == groupPrimitiveNum)
+            {
+                return;
+            }
+
+            if (0 < missNum)
+            {
+                _renderingContext->outputVertexBatch(missVertexPreTLs, missVertexPostTLs, missNum, &_vertexBatch);
+            }
+
+            for (int i = 0; i < groupPrimitiveNum; i++)
+            {
+                _renderingContext->outputPrimitive(_primitiveType, &(vertices[i * _primitiveVertexNum]), _primitiveVertexNum);
+            }
+
+            _vertexCache->unlockEntries();
+        }
+    }
+
+    // ストリップは直前の頂点をそのまま使えるので、頂点キャッシュは通さない
+    void InputAssemblyStage::executeVertexStripLoop()
+    {
+        while (_readVertexCount < _drawParam->count)
+        {
+            uint32_t index = readIndex(_readVertexCount);
+            _readVertexCount++;
+
+            if (isPrimitiveRestartIndex(index))
+            {
+                finishStrip();
+                continue;
+            }
+
+            int vertexIndex = toVertexIndex(index);
+
+            // gen vertex id.
+            int vertexId = vertexIndex;
+
+            // 先頭の頂点はファンとループの最後まで残す
+            VertexDataB* vertex = (0 == _stripVertexCount) ? &(_stripVertexStorage[3]) : &(_stripVertexStorage[_stripVertexCount % 3]);
+
+            VertexDataA vertexPreTL;
+            vertexPreTL.vertexId = vertexId;
+            vertexPreTL.instanceId = _instanceId;
+            VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, _instanceId, &vertexPreTL);
+
+            _renderingContext->outputVertex(&vertexPreTL, vertex);
+
+            assembleStripVertex(vertex);
+        }
+
+        finishStrip();
+    }
+
+    void InputAssemblyStage::assembleStripVertex(VertexDataB* vertex)
+    {
+        VertexDataB* vertices[3];
+
+        switch (_primitiveTopologyType)
+        {
+        case PrimitiveTopologyType::kLineStrip:
+        case PrimitiveTopologyType::kLineLoop:
+            if (1 <= _stripVertexCount)
+            {
+                vertices[0] = _stripPrevVertices[1];
+                vertices[1] = vertex;
+                _renderingContext->outputPrimitive(_primitiveType, vertices, 2);
+            }
+            break;
+        case PrimitiveTopologyType::kTriangleStrip:
+            if (2 <= _stripVertexCount)
+            {
+                // 奇数番目の三角形は向きを揃えるために入れ替える
+                bool odd = (0 != (_stripVertexCount & 1));
+                vertices[0] = odd ? _stripPrevVertices[1] : _stripPrevVertices[0];
+                vertices[1] = odd ? _stripPrevVertices[0] : _stripPrevVertices[1];
+                vertices[2] = vertex;
+                _renderingContext->outputPrimitive(_primitiveType, vertices, 3);
+            }
+            break;
+        case PrimitiveTopologyType::kTriangleFan:
+            if (2 <= _stripVertexCount)
+            {
+                vertices[0] = _stripFirstVertex;
+                vertices[1] = _stripPrevVertices[1];
+                vertices[2] = vertex;
+                _renderingContext->outputPrimitive(_primitiveType, vertices, 3);
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (0 == _stripVertexCount)
+        {
+            _stripFirstVertex = vertex;
+        }
+        _stripPrevVertices[0] = _stripPrevVertices[1];
+        _stripPrevVertices[1] = vertex;
+        _stripVertexCount++;
+    }
+
+    void InputAssemblyStage::finishStrip()
+    {
+        // ループを閉じる
+        if ((PrimitiveTopologyType::kLineLoop == _primitiveTopologyType) && (2 <= _stripVertexCount))
+        {
+            VertexDataB* vertices[2] = { _stripPrevVertices[1], _stripFirstVertex };
+            _renderingContext->outputPrimitive(_primitiveType, vertices, 2);
+        }
+
+        _stripVertexCount = 0;
+        _stripFirstVertex = nullptr;
+        _stripPrevVertices[0] = nullptr;
+        _stripPrevVertices[1] = nullptr;
+    }
+
+    // 変換済み頂点のバッファを次のチャンクで上書きする前に、途中のストリップが参照している頂点を退避する
+    void InputAssemblyStage::retainStripVertices()
+    {
+        VertexDataB** references[3] = { &_stripFirstVertex, &_stripPrevVertices[0], &_stripPrevVertices[1] };
+
+        // 退避先と退避元が重なることがあるので、一度コピーしてから書き戻す
+        VertexDataB* sources[3];
+        VertexDataB copies[3];
+        int retainedNum = 0;
+        int slots[3];
+        for (int i = 0; i < 3; i++)
+        {
+            VertexDataB* vertex = *(references[i]);
+            slots[i] = -1;
+            if (nullptr == vertex)
+            {
+                continue;
+            }
+
+            for (int j = 0; j < retainedNum; j++)
+            {
+                if (sources[j] == vertex)
+                {
+                    slots[i] = j;
+                    break;
+                }
+            }
+
+            if (-1 == slots[i])
+            {
+                sources[retainedNum] = vertex;
+                copies[retainedNum] = *vertex;
+                slots[i] = retainedNum;
+                retainedNum++;
+            }
+        }
+
+        for (int i = 0; i < retainedNum; i++)
+        {
+            _stripRetainedVertices[i] = copies[i];
+        }
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (-1 != slots[i])
+            {
+                *(references[i]) = &(_stripRetainedVertices[slots[i]]);
+            }
+        }
+    }
+
+    // 参照される頂点を先にすべてシェーディングしておき、プリミティブはインデックスで直接組み立てる
+    // 大きな描画でもメモリが一定量で済むよう、インデックスを区切って処理する
+    void InputAssemblyStage::executePreTransformLoop()
+    {
+        if (0 == _primitiveVertexNum)
+        {
+            return;
+        }
+
+        bool listTopology = isListTopology();
+
+        int indexNum = _drawParam->count;
+        if (listTopology)
+        {
+            indexNum -= (indexNum % _primitiveVertexNum);
+        }
+
+        // チャンクごとの作業領域は描画ごとのアロケータから取り、チャンクの先頭で巻き戻して使い回す
+        LinearAllocator::Marker chunkMarker = _transientAllocator->getMarker();
+
+        for (int chunkBegin = 0; chunkBegin < indexNum; chunkBegin += kPreTransformChunkIndexNum)
+        {
+            _transientAllocator->rewind(chunkMarker);
+
+            int chunkIndexNum = std::min(kPreTransformChunkIndexNum, indexNum - chunkBegin);
+
+            // チャンク内のインデックスを頂点番号に変換
+            int* chunkVertexIndices = _transientAllocator->allocate<int>(chunkIndexNum);
+            int minVertexIndex = INT_MAX;
+            int maxVertexIndex = INT_MIN;
+            for (int i = 0; i < chunkIndexNum; i++)
+            {
+                uint32_t index = readIndex(chunkBegin + i);
+                if (!listTopology && isPrimitiveRestartIndex(index))
+                {
+                    chunkVertexIndices[i] = -1;
+                    continue;
+                }
+
+                int vertexIndex = toVertexIndex(index);
+                chunkVertexIndices[i] = vertexIndex;
+                minVertexIndex = std::min(minVertexIndex, vertexIndex);
+                maxVertexIndex = std::max(maxVertexIndex, vertexIndex);
+            }
+
+            // チャンク内がすべてリスタートインデックス
+            if (maxVertexIndex < minVertexIndex)
+            {
+                finishStrip();
+                continue;
+            }
+
+            // 参照される頂点の一覧（範囲が狭ければ範囲ごと、広ければ重複を除いた一覧）
+            bool denseRange = ((int64_t)maxVertexIndex - minVertexIndex) < kPreTransformChunkIndexNum;
+            int* chunkUniqueVertexIndices = nullptr;
+            int vertexNum = 0;
+            if (denseRange)
+            {
+                vertexNum = maxVertexIndex - minVertexIndex + 1;
+                chunkUniqueVertexIndices = _transientAllocator->allocate<int>(vertexNum);
+                for (int i = 0; i < vertexNum; i++)
+                {
+                    chunkUniqueVertexIndices[i] = minVertexIndex + i;
+                }
+            }
+            else
+            {
+                chunkUniqueVertexIndices = _transientAllocator->allocate<int>(chunkIndexNum);
+                for (int i = 0; i < chunkIndexNum; i++)
+                {
+                    if (-1 != chunkVertexIndices[i])
+                    {
+                        chunkUniqueVertexIndices[vertexNum] = chunkVertexIndices[i];
+                        vertexNum++;
+                    }
+                }
+                std::sort(chunkUniqueVertexIndices, chunkUniqueVertexIndices + vertexNum);
+                vertexNum = (int)(std::unique(chunkUniqueVertexIndices, chunkUniqueVertexIndices + vertexNum) - chunkUniqueVertexIndices);
+            }
 
-                    VertexDataA* vertex = &(entry->vertexPreTL);
-                    vertex->vertexId = vertexId;
-                    VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, vertex);
+            VertexDataB* preTransformedVertices = _transientAllocator->allocate<VertexDataB>(vertexNum);
 
-                    _renderingContext->outputVertex(entry);
+            auto findTransformedVertex = [&](int vertexIndex) -> VertexDataB*
+            {
+                if (denseRange)
+                {
+                    return &(preTransformedVertices[vertexIndex - minVertexIndex]);
                 }
+                const int* it = std::lower_bound(chunkUniqueVertexIndices, chunkUniqueVertexIndices + vertexNum, vertexIndex);
+                return &(preTransformedVertices[it - chunkUniqueVertexIndices]);
+            };
+
+            // 前のチャンクから続くストリップの頂点を退避してからバッファを上書き
+            if (!listTopology)
+            {
+                retainStripVertices();
+            }
+
+            transformVertexList(chunkUniqueVertexIndices, vertexNum, preTransformedVertices);
 
-                entries[i] = entry;
+            if (listTopology)
+            {
+                VertexDataB* vertices[3];
+                for (int i = 0; i < chunkIndexNum; i += _primitiveVertexNum)
+                {
+                    for (int j = 0; j < _primitiveVertexNum; j++)
+                    {
+                        vertices[j] = findTransformedVertex(chunkVertexIndices[i + j]);
+                    }
+
+                    _renderingContext->outputPrimitive(_primitiveType, vertices, _primitiveVertexNum);
+                }
             }
+            else
+            {
+                for (int i = 0; i < chunkIndexNum; i++)
+                {
+                    int vertexIndex = chunkVertexIndices[i];
+                    if (-1 == vertexIndex)
+                    {
+                        finishStrip();
+                        continue;
+                    }
+
+                    assembleStripVertex(findTransformedVertex(vertexIndex));
+                }
+            }
+        }
+
+        _transientAllocator->rewind(chunkMarker);
+
+        if (!listTopology)
+        {
+            finishStrip();
+        }
+
+        _readVertexCount = indexNum;
+    }
+
+    void InputAssemblyStage::transformVertexList(const int* vertexIndices, int vertexNum, VertexDataB* outputVertices)
+    {
+        int threadNum = _vertexProcessingState->threadNum;
+        if (threadNum <= 0)
+        {
+            threadNum = (int)std::thread::hardware_concurrency();
+        }
+        threadNum = std::clamp(std::min(threadNum, vertexNum / kPreTransformThreadMinVertexNum), 1, vertexNum);
+
+        // スレッドごとのバッチ用の作業領域（スレッドを起こす前にまとめて確保しておく）
+        TransformScratch* scratches = nullptr;
+        if (_vertexShaderProgram->vertexBatchShaderMain)
+        {
+            scratches = _transientAllocator->allocate<TransformScratch>(threadNum);
+        }
 
-            _renderingContext->outputPrimitive(_primitiveType, entries, _primitiveVertexNum);
+        if (1 == threadNum)
+        {
+            transformVertexChunk(vertexIndices, vertexNum, outputVertices, scratches);
+            return;
+        }
+
+        // 頂点の一覧をスレッド数で等分（先頭のチャンクは呼び出し元のスレッドで処理）
+        int chunkVertexNum = (vertexNum + threadNum - 1) / threadNum;
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadNum - 1);
+        for (int begin = chunkVertexNum, threadIndex = 1; begin < vertexNum; begin += chunkVertexNum, threadIndex++)
+        {
+            int num = std::min(chunkVertexNum, vertexNum - begin);
+            TransformScratch* scratch = scratches ? &(scratches[threadIndex]) : nullptr;
+            threads.emplace_back(&InputAssemblyStage::transformVertexChunk, this, vertexIndices + begin, num, outputVertices + begin, scratch);
+        }
+
+        transformVertexChunk(vertexIndices, std::min(chunkVertexNum, vertexNum), outputVertices, scratches);
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // スレッドから呼ばれるので、メンバーの作業領域は使わない
+    void InputAssemblyStage::transformVertexChunk(const int* vertexIndices, int vertexNum, VertexDataB* outputVertices, TransformScratch* scratch)
+    {
+        if (_vertexShaderProgram->vertexBatchShaderMain)
+        {
+            VertexDataA* vertexPreTLs = scratch->vertexPreTLs;
+            VertexBatchData* vertexBatch = &(scratch->vertexBatch);
+
+            const VertexDataA* inputVertices[kVertexBatchMaxSize];
+            VertexDataB* batchOutputVertices[kVertexBatchMaxSize];
+
+            for (int begin = 0; begin < vertexNum; begin += kVertexBatchMaxSize)
+            {
+                int batchVertexNum = std::min(kVertexBatchMaxSize, vertexNum - begin);
+                for (int lane = 0; lane < batchVertexNum; lane++)
+                {
+                    int vertexIndex = vertexIndices[begin + lane];
+
+                    VertexDataA* vertex = &(vertexPreTLs[lane]);
+                    vertex->vertexId = vertexIndex;
+                    vertex->instanceId = _instanceId;
+                    VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, _instanceId, vertex);
+
+                    inputVertices[lane] = vertex;
+                    batchOutputVertices[lane] = &(outputVertices[begin + lane]);
+                }
+
+                _renderingContext->outputVertexBatch(inputVertices, batchOutputVertices, batchVertexNum, vertexBatch);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < vertexNum; i++)
+            {
+                int vertexIndex = vertexIndices[i];
+
+                VertexDataA vertex;
+                vertex.vertexId = vertexIndex;
+                vertex.instanceId = _instanceId;
+                VertexFetchUnit::FetchVertex(_inputLayout, _vertexBuffers, vertexIndex, _instanceId, &vertex);
+
+                _renderingContext->outputVertex(&vertex, &(outputVertices[i]));
+            }
         }
     }
 
@@ -3,9 +3,13 @@
 #include "..\State\InputLayout.h"
 #include "..\State\VertexBuffers.h"
 #include "..\State\IndexBuffer.h"
+#include "..\State\DrawParam.h"
+#include "..\State\VertexShaderProgram.h"
+#include "..\State\VertexProcessingState.h"
+#include "..\Modules\VertexCache.h"
+#include "..\Modules\LinearAllocator.h"
 #include "..\Core\Types.h"
 #include <cstdint>
-#include <vector>
 
 namespace SoftwareRasterizer
 {
@@ -22,31 +26,77 @@ namespace SoftwareRasterizer
         void input(const InputLayout* inputLayout) { _inputLayout = inputLayout;  }
         void input(const VertexBuffers* vertexBuffers) { _vertexBuffers = vertexBuffers; }
         void input(const IndexBuffer* indexBuffer) { _indexBuffer = indexBuffer; }
-        void input(PrimitiveTopologyType primitiveTopologyType) { _primitiveTopologyType = primitiveTopologyType; }
+        void input(const DrawParam* drawParam) { _drawParam = drawParam; }
+        void input(const VertexShaderProgram* vertexShaderProgram) { _vertexShaderProgram = vertexShaderProgram; }
+        void input(const VertexProcessingState* vertexProcessingState) { _vertexProcessingState = vertexProcessingState; }
 
+        void output(VertexCache* vertexCache) { _vertexCache = vertexCache; }
+        void output(LinearAllocator* transientAllocator) { _transientAllocator = transientAllocator; }
         void output(class RenderingContext* renderingContext) { _renderingContext = renderingContext; }
 
         void prepareReadPrimitive();
 
         void executeVertexLoop();
 
+    private:
+
+        void executeInstanceLoop();
+        void executeVertexBatchLoop();
+        void executeVertexStripLoop();
+
+        bool isListTopology() const;
+        uint32_t readIndex(int i) const;
+        bool isPrimitiveRestartIndex(uint32_t index) const;
+        int toVertexIndex(uint32_t index) const;
+
+        void assembleStripVertex(VertexDataB* vertex);
+        void finishStrip();
+        void retainStripVertices();
+
+        void executePreTransformLoop();
+        // スレッドごとのバッチ用の作業領域
+        struct TransformScratch
+        {
+            VertexDataA vertexPreTLs[kVertexBatchMaxSize];
+            VertexBatchData vertexBatch;
+        };
+
+        void transformVertexList(const int* vertexIndices, int vertexNum, VertexDataB* outputVertices);
+        void transformVertexChunk(const int* vertexIndices, int vertexNum, VertexDataB* outputVertices, TransformScratch* scratch);
+
     private:
 
         // input
         const InputLayout* _inputLayout = nullptr;
         const VertexBuffers* _vertexBuffers = nullptr;
         const IndexBuffer* _indexBuffer = nullptr;
-        PrimitiveTopologyType _primitiveTopologyType = PrimitiveTopologyType::kNone;
+        const DrawParam* _drawParam = nullptr;
+        const VertexShaderProgram* _vertexShaderProgram = nullptr;
+        const VertexProcessingState* _vertexProcessingState = nullptr;
 
         // output
+        VertexCache* _vertexCache = nullptr;
+        LinearAllocator* _transientAllocator = nullptr;
         class RenderingContext* _renderingContext = nullptr;
 
     private:
 
+        PrimitiveTopologyType _primitiveTopologyType = PrimitiveTopologyType::kNone;
         PrimitiveType _primitiveType = PrimitiveType::kNone;
         int _primitiveVertexNum = 0;
 
         int _readVertexCount = 0;
+        int _instanceId = 0;
+
+        // ストリップ、ファン、ループ
+        int _stripVertexCount = 0;
+        VertexDataB* _stripFirstVertex = nullptr;
+        VertexDataB* _stripPrevVertices[2] = {};// [0]:２つ前, [1]:１つ前
+        VertexDataB _stripVertexStorage[4];// [0]～[2]:直近の頂点, [3]:先頭の頂点
+        VertexDataB _stripRetainedVertices[3];// 事前変換のチャンクをまたぐ頂点
+
+        VertexDataA _vertexPreTLs[kVertexBatchMaxSize];// バッチ用のフェッチ結果
+        VertexBatchData _vertexBatch = {};
 
     };
 }
@@ -32,24 +32,112 @@
 #include "OutputMergerStage.h"
 #include "..\Modules\TextureOperations.h" 
 #include "..\Modules\CompareTest.h" 
-#include "..\..\Lib\Algorithm.h"
-#include <algorithm>// clamp
+#include "..\Modules\InterpolationUnit.h"
+#include <algorithm>// min max clamp
+#include <iterator>// std::size
+#include <cassert>
 
 namespace SoftwareRasterizer
 {
+    // タイル内のテクセルのビット
+    static uint64_t GetTileTexelBit(int x, int y)
+    {
+        int inTileX = x & (kTextureTileSize - 1);
+        int inTileY = y & (kTextureTileSize - 1);
+        return (1ull << ((inTileY << kTextureTileSizeLog2) + inTileX));
+    }
+
     OutputMergerStage::OutputMergerStage()
     {
     }
 
-    void OutputMergerStage::execute(const IntVector2& texelCoord, const PixelData* pixel)
+    void OutputMergerStage::prepareDepthState()
+    {
+        switch (_renderTarget->depthFormat)
+        {
+        case DepthFormat::kD16:
+            prepareDepthKernel<DepthFormat::kD16>();
+            break;
+        case DepthFormat::kD24S8:
+            prepareDepthKernel<DepthFormat::kD24S8>();
+            break;
+        case DepthFormat::kD32F:
+            prepareDepthKernel<DepthFormat::kD32F>();
+            break;
+        }
+    }
+
+    template<DepthFormat Format>
+    void OutputMergerStage::prepareDepthKernel()
+    {
+        // ComparisonFunc の値の順に並べる
+        static const ExecuteFuncPtr kDepthTestKernels[] =
+        {
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kNone, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kNever, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kLess, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kEqual, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kLessEqual, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kGreater, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kNotEqual, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kGreaterEqual, Format>,
+            &OutputMergerStage::executeKernel<true, ComparisonFunc::kAlways, Format>,
+        };
+
+        if (!_depthState->depthTestEnabled)
+        {
+            _executeFunc = &OutputMergerStage::executeKernel<false, ComparisonFunc::kAlways, Format>;
+            return;
+        }
+
+        int kernelIndex = (int)_depthState->depthFunc;
+        assert(0 <= kernelIndex && kernelIndex < std::size(kDepthTestKernels));
+        _executeFunc = kDepthTestKernels[kernelIndex];
+    }
+
+    void OutputMergerStage::prepareDepthRange()
+    {
+        _depthRangeNearVal = _depthRange->depthRangeNearVal;
+        _depthRangeInvLength = 1.0f / (_depthRange->depthRangeFarVal - _depthRange->depthRangeNearVal);
+    }
+
+    template<bool DepthTestEnabled, ComparisonFunc DepthFunc, DepthFormat Format>
+    void OutputMergerStage::executeKernel(const IntVector2& texelCoord, const PixelData* pixel)
     {
-        float normarizedDpeth = normalizeDepth(pixel->depth);
+        typedef DepthFormatTraits<Format> DepthTraits;
+        typedef typename DepthTraits::NativeType DepthType;
+
+        DepthType* depthTexel = (DepthType*)TextureOperations::GetTexelAddress(&(_renderTarget->depthBuffer), texelCoord, sizeof(DepthType));
+        if (nullptr == depthTexel)
+        {
+            return;
+        }
+
+        // 平面で表したタイル
+        int tileX = texelCoord.x >> kTextureTileSizeLog2;
+        int tileY = texelCoord.y >> kTextureTileSizeLog2;
+        DepthTileHeader* header = _depthTileCompression->getHeader(tileX, tileY);
+        if (DepthTileMode::kRaw != header->mode)
+        {
+            if (DepthTileMode::kPending == header->mode)
+            {
+                // 深度テストに通ることはわかっていて、深度は三角形の平面で表す
+                header->pendingMask |= GetTileTexelBit(texelCoord.x, texelCoord.y);
+                storePixelColor(texelCoord, pixel->color);
+                return;
+            }
+
+            decompressDepthTile<Format>(header, tileX, tileY);
+        }
+
+        // 深度は格納値に変換してから比較し、そのまま書き込む（格納値から戻す変換はしない）
+        DepthType depth = DepthTraits::Convert(normalizeDepth(pixel->depth));
 
-        if (_depthState->depthTestEnabled)
+        if constexpr (DepthTestEnabled)
         {
-            float storedDepth = fetchPixelDepth(texelCoord);
+            DepthType storedDepth = DepthTraits::Load(depthTexel);
 
-            bool passed = depthTest(normarizedDpeth, storedDepth);
+            bool passed = CompareTest::Perform<DepthFunc>(depth, storedDepth);
             if (!passed)
             {
                 return;
@@ -57,36 +145,267 @@ namespace SoftwareRasterizer
         }
 
         storePixelColor(texelCoord, pixel->color);
-        storePixelDepth(texelCoord, normarizedDpeth);
+        DepthTraits::Store(depthTexel, depth);
     }
 
-    float OutputMergerStage::normalizeDepth(float depth) const
+    bool OutputMergerStage::beginDepthTiles(const DepthPlane& trianglePlane, int minX, int minY, int maxX, int maxY)
     {
-        // [0,1] にマップする
-        float a = _depthRange->depthRangeNearVal;
-        float b = _depthRange->depthRangeFarVal;
-        float t = Lib::InverseLerp(a, b, depth);
-        return std::clamp(t, 0.0f, 1.0f);// saturate
+        DepthPlane plane = trianglePlane;
+        plane.depthRangeNearVal = _depthRangeNearVal;
+        plane.depthRangeInvLength = _depthRangeInvLength;
+
+        switch (_renderTarget->depthFormat)
+        {
+        case DepthFormat::kD16:
+            return classifyDepthTiles<DepthFormat::kD16>(plane, minX, minY, maxX, maxY);
+        case DepthFormat::kD24S8:
+            return classifyDepthTiles<DepthFormat::kD24S8>(plane, minX, minY, maxX, maxY);
+        case DepthFormat::kD32F:
+            return classifyDepthTiles<DepthFormat::kD32F>(plane, minX, minY, maxX, maxY);
+        }
+        return false;
     }
 
-    bool OutputMergerStage::depthTest(float depth, float storedDepth) const
+    void OutputMergerStage::finishDepthTiles()
     {
-        return CompareTest::Perform(_depthState->depthFunc, depth, storedDepth);
+        switch (_renderTarget->depthFormat)
+        {
+        case DepthFormat::kD16:
+            commitDepthTiles<DepthFormat::kD16>();
+            break;
+        case DepthFormat::kD24S8:
+            commitDepthTiles<DepthFormat::kD24S8>();
+            break;
+        case DepthFormat::kD32F:
+            commitDepthTiles<DepthFormat::kD32F>();
+            break;
+        }
     }
 
-    void OutputMergerStage::storePixelColor(const IntVector2& texelCoord, const Vector4& color)
+    template<DepthFormat Format>
+    bool OutputMergerStage::classifyDepthTiles(const DepthPlane& plane, int minX, int minY, int maxX, int maxY)
     {
-        TextureOperations::StoreTexelColor(&(_renderTarget->colorBuffer), texelCoord, color);
+        typedef DepthFormatTraits<Format> DepthTraits;
+        typedef typename DepthTraits::NativeType DepthType;
+
+        DepthTileCompression* tiles = _depthTileCompression;
+        uint32_t primitiveStamp = tiles->beginPrimitive();
+
+        bool depthTestEnabled = _depthState->depthTestEnabled;
+        ComparisonFunc depthFunc = _depthState->depthFunc;
+
+        // 範囲に完全に含まれるタイルだけを調べる
+        int tileMinX = (std::max(minX, 0) + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileMinY = (std::max(minY, 0) + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileMaxX = ((std::min(maxX, tiles->getWidth() - 1) + 1) >> kTextureTileSizeLog2) - 1;
+        int tileMaxY = ((std::min(maxY, tiles->getHeight() - 1) + 1) >> kTextureTileSizeLog2) - 1;
+
+        int planeIndex = -1;
+        bool culled = false;
+
+        for (int tileY = tileMinY; tileY <= tileMaxY; tileY++)
+        {
+            for (int tileX = tileMinX; tileX <= tileMaxX; tileX++)
+            {
+                DepthTileHeader* header = tiles->getHeader(tileX, tileY);
+                const DepthType* texels = (const DepthType*)TextureOperations::GetTileAddress(&(_renderTarget->depthBuffer), tileX, tileY, sizeof(DepthType));
+
+                uint64_t coveredMask = 0;
+                uint64_t passedMask = 0;
+                for (int i = 0; i < kTextureTileTexelNum; i++)
+                {
+                    int x = (tileX << kTextureTileSizeLog2) + (i & (kTextureTileSize - 1));
+                    int y = (tileY << kTextureTileSizeLog2) + (i >> kTextureTileSizeLog2);
+
+                    // RasterizeStage::getTriangleFragment と同じ内外判定と補間
+                    Vector2 p_wndCoord(x + 0.5f, y + 0.5f);
+                    BarycentricCoord baryCoord = InterpolationUnit::ComputeBarycentricCoord(plane.wndCoords[0], plane.wndCoords[1], plane.wndCoords[2], plane.sarea, p_wndCoord);
+                    if (baryCoord.r1 < 0.0f || baryCoord.r2 < 0.0f || baryCoord.r3 < 0.0f)
+                    {
+                        // 平面で表していないタイルは、三角形で覆われるときだけ扱う
+                        if (DepthTileMode::kRaw == header->mode)
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+
+                    uint64_t texelBit = (1ull << i);
+                    coveredMask |= texelBit;
+
+                    if (!depthTestEnabled)
+                    {
+                        passedMask |= texelBit;
+                        continue;
+                    }
+
+                    float depth = InterpolationUnit::InterpolateBarycentric(plane.depths[0], plane.depths[1], plane.depths[2], &baryCoord);
+                    DepthType newDepth = DepthTraits::Convert(DepthTileCompression::NormalizeDepth(plane, depth));
+
+                    DepthType storedDepth;
+                    if (DepthTileMode::kRaw == header->mode)
+                    {
+                        storedDepth = DepthTraits::Load(&(texels[i]));
+                    }
+                    else
+                    {
+                        int storedPlaneIndex = (header->planeMask & texelBit) ? header->planeIndices[1] : header->planeIndices[0];
+                        storedDepth = DepthTraits::Convert(DepthTileCompression::EvaluatePlane(tiles->getPlane(storedPlaneIndex), x, y));
+                    }
+
+                    if (CompareTest::Perform(depthFunc, (float)newDepth, (float)storedDepth))
+                    {
+                        passedMask |= texelBit;
+                    }
+                }
+
+                bool fullyCovered = (~0ull == coveredMask);
+                if (0 == coveredMask || (DepthTileMode::kRaw == header->mode && !fullyCovered))
+                {
+                    continue;
+                }
+
+                if (0 == passedMask)
+                {
+                    // すべて失敗するのでラスタライズしない
+                    header->cullStamp = primitiveStamp;
+                    culled = true;
+                }
+                else if (passedMask == coveredMask)
+                {
+                    // すべて通るので、書き込まれたテクセルを後で三角形の平面にする
+                    if (-1 == planeIndex)
+                    {
+                        planeIndex = tiles->addPlane(plane);
+                    }
+                    if (0 <= planeIndex)
+                    {
+                        header->pendingBaseMode = header->mode;
+                        header->mode = DepthTileMode::kPending;
+                        header->pendingPlaneIndex = planeIndex;
+                        header->pendingMask = 0;
+                        tiles->addPendingTile(tileX, tileY);
+                    }
+                }
+            }
+        }
+
+        return culled;
+    }
+
+    template<DepthFormat Format>
+    void OutputMergerStage::commitDepthTiles()
+    {
+        DepthTileCompression* tiles = _depthTileCompression;
+
+        for (int tileIndex : tiles->getPendingTiles())
+        {
+            int tileX = tileIndex % tiles->getTileNumX();
+            int tileY = tileIndex / tiles->getTileNumX();
+
+            DepthTileHeader* header = tiles->getHeader(tileIndex);
+            assert(DepthTileMode::kPending == header->mode);
+            header->mode = header->pendingBaseMode;
+
+            uint64_t writtenMask = header->pendingMask;
+            if (0 == writtenMask)
+            {
+                continue;
+            }
+
+            int planeIndex = header->pendingPlaneIndex;
+
+            if (DepthTileMode::kPlane == header->mode)
+            {
+                // 元の平面のうち、まだ使われている平面と合わせて２枚までなら平面のまま
+                uint64_t plane0Mask = ~(header->planeMask) & ~writtenMask;
+                uint64_t plane1Mask = header->planeMask & ~writtenMask;
+                if (0 == plane0Mask && 0 == plane1Mask)
+                {
+                    header->planeIndices[0] = planeIndex;
+                    header->planeIndices[1] = planeIndex;
+                    header->planeMask = 0;
+                    continue;
+                }
+                if (0 == plane1Mask)
+                {
+                    header->planeIndices[1] = planeIndex;
+                    header->planeMask = writtenMask;
+                    continue;
+                }
+                if (0 == plane0Mask)
+                {
+                    header->planeIndices[0] = header->planeIndices[1];
+                    header->planeIndices[1] = planeIndex;
+                    header->planeMask = writtenMask;
+                    continue;
+                }
+
+                // ３枚になるので展開する
+                decompressDepthTile<Format>(header, tileX, tileY);
+            }
+            else if (~0ull == writtenMask)
+            {
+                header->mode = DepthTileMode::kPlane;
+                header->planeIndices[0] = planeIndex;
+                header->planeIndices[1] = planeIndex;
+                header->planeMask = 0;
+                continue;
+            }
+
+            writeDepthPlaneTexels<Format>(tiles->getPlane(planeIndex), writtenMask, tileX, tileY);
+        }
+
+        tiles->clearPendingTiles();
+    }
+
+    template<DepthFormat Format>
+    void OutputMergerStage::decompressDepthTile(DepthTileHeader* header, int tileX, int tileY)
+    {
+        assert(DepthTileMode::kPlane == header->mode);
+
+        uint64_t plane1Mask = header->planeMask;
+        const DepthPlane& plane0 = _depthTileCompression->getPlane(header->planeIndices[0]);
+        const DepthPlane& plane1 = _depthTileCompression->getPlane(header->planeIndices[1]);
+        writeDepthPlaneTexels<Format>(plane0, ~plane1Mask, tileX, tileY);
+        if (0 != plane1Mask)
+        {
+            writeDepthPlaneTexels<Format>(plane1, plane1Mask, tileX, tileY);
+        }
+
+        header->mode = DepthTileMode::kRaw;
     }
 
-    float OutputMergerStage::fetchPixelDepth(const IntVector2& texelCoord) const
+    template<DepthFormat Format>
+    void OutputMergerStage::writeDepthPlaneTexels(const DepthPlane& plane, uint64_t texelMask, int tileX, int tileY)
     {
-        return TextureOperations::FetchTexelDepth(&(_renderTarget->depthBuffer), texelCoord);
+        typedef DepthFormatTraits<Format> DepthTraits;
+        typedef typename DepthTraits::NativeType DepthType;
+
+        DepthType* texels = (DepthType*)TextureOperations::GetTileAddress(&(_renderTarget->depthBuffer), tileX, tileY, sizeof(DepthType));
+        for (int i = 0; i < kTextureTileTexelNum; i++)
+        {
+            if (texelMask & (1ull << i))
+            {
+                int x = (tileX << kTextureTileSizeLog2) + (i & (kTextureTileSize - 1));
+                int y = (tileY << kTextureTileSizeLog2) + (i >> kTextureTileSizeLog2);
+                DepthTraits::Store(&(texels[i]), DepthTraits::Convert(DepthTileCompression::EvaluatePlane(plane, x, y)));
+            }
+        }
+    }
+
+    float OutputMergerStage::normalizeDepth(float depth) const
+    {
+        // [0,1] にマップする（Lib::InverseLerp の除算を逆数の乗算に置き換えたもの）
+        float t = (depth - _depthRangeNearVal) * _depthRangeInvLength;
+        return std::clamp(t, 0.0f, 1.0f);// saturate
     }
 
-    void OutputMergerStage::storePixelDepth(const IntVector2& texelCoord, float depth)
+    void OutputMergerStage::storePixelColor(const IntVector2& texelCoord, const Vector4& color)
     {
-        TextureOperations::StoreTexelDepth(&(_renderTarget->depthBuffer), texelCoord, depth);
+        // texelCoord は範囲内（深度バッファで確認済み）
+        _colorTileClear->touchTile(&(_renderTarget->colorBuffer), texelCoord.x >> kTextureTileSizeLog2, texelCoord.y >> kTextureTileSizeLog2);
+        TextureOperations::StoreTexelColor(&(_renderTarget->colorBuffer), texelCoord, color);
     }
 
 }
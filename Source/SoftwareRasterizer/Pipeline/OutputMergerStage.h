@@ -3,6 +3,8 @@
 #include "..\State\DepthState.h"
 #include "..\State\DepthRange.h"
 #include "..\State\RenderTarget.h"
+#include "..\Modules\DepthTileCompression.h"
+#include "..\Modules\ColorTileClear.h"
 #include "..\Core\Types.h"
 
 namespace SoftwareRasterizer
@@ -18,19 +20,41 @@ namespace SoftwareRasterizer
         void input(const DepthRange* depthRange) { _depthRange = depthRange; }
 
         void output(RenderTarget* renderTarget) { _renderTarget = renderTarget; }
+        void output(DepthTileCompression* depthTileCompression) { _depthTileCompression = depthTileCompression; }
+        void output(ColorTileClear* colorTileClear) { _colorTileClear = colorTileClear; }
 
-        void execute(const IntVector2& texelCoord, const PixelData* pixel);
+        void prepareDepthState();
+        void prepareDepthRange();
+
+        void execute(const IntVector2& texelCoord, const PixelData* pixel) { (this->*_executeFunc)(texelCoord, pixel); }
+
+        // 三角形が覆う深度タイルを先に判定する（すべて失敗するタイルはカリング、すべて通るタイルは平面で上書き）
+        // カリングしたタイルがあれば true
+        bool beginDepthTiles(const DepthPlane& plane, int minX, int minY, int maxX, int maxY);
+        void finishDepthTiles();
 
     private:
 
+        template<DepthFormat Format>
+        void prepareDepthKernel();
+
+        template<bool DepthTestEnabled, ComparisonFunc DepthFunc, DepthFormat Format>
+        void executeKernel(const IntVector2& texelCoord, const PixelData* pixel);
+
+        template<DepthFormat Format>
+        bool classifyDepthTiles(const DepthPlane& plane, int minX, int minY, int maxX, int maxY);
+        template<DepthFormat Format>
+        void commitDepthTiles();
+
+        template<DepthFormat Format>
+        void decompressDepthTile(DepthTileHeader* header, int tileX, int tileY);
+        template<DepthFormat Format>
+        void writeDepthPlaneTexels(const DepthPlane& plane, uint64_t texelMask, int tileX, int tileY);
+
         float normalizeDepth(float depth) const;
-        bool depthTest(float depth, float storedDepth) const;
 
         void storePixelColor(const IntVector2& texelCoord, const Vector4& color);
 
-        float fetchPixelDepth(const IntVector2& texelCoord) const;
-        void storePixelDepth(const IntVector2& texelCoord, float depth);
-
     private:
 
         // input
@@ -39,6 +63,18 @@ namespace SoftwareRasterizer
 
         // output
         RenderTarget* _renderTarget = nullptr;
-        
+        DepthTileCompression* _depthTileCompression = nullptr;
+        ColorTileClear* _colorTileClear = nullptr;
+
+    private:
+
+        // 深度範囲の逆変換の係数（prepareDepthRange で作る）
+        float _depthRangeNearVal = 0.0f;
+        float _depthRangeInvLength = 1.0f;
+
+        // 深度ステートと深度フォーマットで特殊化したカーネル（prepareDepthState で選ぶ）
+        typedef void (OutputMergerStage::*ExecuteFuncPtr)(const IntVector2& texelCoord, const PixelData* pixel);
+        ExecuteFuncPtr _executeFunc = nullptr;
+
     };
 }
@@ -44,6 +44,57 @@ namespace SoftwareRasterizer
         _rasterizer.setSsanlineNum(_windowSize->windowHeight);
     }
 
+    void RasterizeStage::prepareViewportTransform()
+    {
+        float x = (float)_viewport->viewportX;
+        float y = (float)_viewport->viewportY;
+        float width = (float)_viewport->viewportWidth;
+        float height = (float)_viewport->viewportHeight;
+
+        _viewportScale = Vector2(width / 2.0f, height / 2.0f);
+        _viewportOffset = Vector2(x, y);
+    }
+
+    bool RasterizeStage::beginDepthTiles(const VertexDataD* p0, const VertexDataD* p1, const VertexDataD* p2)
+    {
+        int minX = (int)std::floor(std::min(p0->wndCoord.x, std::min(p1->wndCoord.x, p2->wndCoord.x)));
+        int maxX = (int)std::floor(std::max(p0->wndCoord.x, std::max(p1->wndCoord.x, p2->wndCoord.x)));
+        int minY = (int)std::floor(std::min(p0->wndCoord.y, std::min(p1->wndCoord.y, p2->wndCoord.y)));
+        int maxY = (int)std::floor(std::max(p0->wndCoord.y, std::max(p1->wndCoord.y, p2->wndCoord.y)));
+
+        minX = std::clamp(minX, _clipRectMinX, _clipRectMaxX);
+        maxX = std::clamp(maxX, _clipRectMinX, _clipRectMaxX);
+        minY = std::clamp(minY, _clipRectMinY, _clipRectMaxY);
+        maxY = std::clamp(maxY, _clipRectMinY, _clipRectMaxY);
+
+        // 完全に含まれるタイルがない小さい三角形はピクセルごとに処理する
+        int tileMinX = (minX + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileMaxX = ((maxX + 1) >> kTextureTileSizeLog2) - 1;
+        int tileMinY = (minY + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileMaxY = ((maxY + 1) >> kTextureTileSizeLog2) - 1;
+        if (tileMaxX < tileMinX || tileMaxY < tileMinY)
+        {
+            return false;
+        }
+
+        DepthPlane plane = {};
+        plane.wndCoords[0] = p0->wndCoord;
+        plane.wndCoords[1] = p1->wndCoord;
+        plane.wndCoords[2] = p2->wndCoord;
+        plane.depths[0] = p0->depth;
+        plane.depths[1] = p1->depth;
+        plane.depths[2] = p2->depth;
+        plane.sarea = _sarea_abc;
+        plane.constant = false;
+
+        return _renderingContext->beginDepthTiles(plane, minX, minY, maxX, maxY);
+    }
+
+    void RasterizeStage::finishDepthTiles()
+    {
+        _renderingContext->finishDepthTiles();
+    }
+
     // 透視除算(W除算)
     void RasterizeStage::applyPerspectiveDivide(const VertexDataB* clipVertex, VertexDataC* ndcVertex)
     {
@@ -54,12 +105,10 @@ namespace SoftwareRasterizer
         ndcVertex->w = ndcCoord.w;//=1.0f
 
         // 補間変数もパースペクティブコレクトでW除算する必要があるので済ませておく
-        for (int i = 0; i < kMaxVaryings; i++)
+        for (int j = 0; j < _varyingIndexState->activeVaryingNum; j++)
         {
-            if (_varyingIndexState->enabledVaryingIndexBits & (1u << i))
-            {
-                ndcVertex->varyingsDividedByW[i] = clipVertex->varyings[i] / clipVertex->clipCoord.w;
-            }
+            int i = _varyingIndexState->activeVaryingIndices[j];
+            ndcVertex->varyingsDividedByW[i] = clipVertex->varyings[i] / clipVertex->clipCoord.w;
         }
     }
 
@@ -88,14 +137,9 @@ namespace SoftwareRasterizer
         //       +----------+  
         //  (x,y)
 
-        float x = (float)_viewport->viewportX;
-        float y = (float)_viewport->viewportY;
-        float width = (float)_viewport->viewportWidth;
-        float height = (float)_viewport->viewportHeight;
-
         return Vector2(
-            ((ndcVertex->ndcCoord.x + 1.0f) * (width / 2.0f)) + x,
-            ((ndcVertex->ndcCoord.y + 1.0f) * (height / 2.0f)) + y
+            ((ndcVertex->ndcCoord.x + 1.0f) * _viewportScale.x) + _viewportOffset.x,
+            ((ndcVertex->ndcCoord.y + 1.0f) * _viewportScale.y) + _viewportOffset.y
         );
     }
 
@@ -125,187 +169,11 @@ namespace SoftwareRasterizer
         wndVertex->invW = 1.0f / clipVertex->clipCoord.w;
 
         // 補間変数もパースペクティブコレクト用にW除算しておく
-        for (int i = 0; i < kMaxVaryings; i++)
-        {
-            if (_varyingIndexState->enabledVaryingIndexBits & (1u << i))
-            {
-                wndVertex->varyingsDividedByW[i] = clipVertex->varyings[i] / clipVertex->clipCoord.w;
-            }
-        }
-    }
-
-    void RasterizeStage::rasterizePrimitive(RasterPrimitive& rasterPrimitive)
-    {
-        VertexDataC ndcVertices[3];
-        for (int i = 0; i < rasterPrimitive.vertexNum; i++)
-        {
-            applyPerspectiveDivide(&(rasterPrimitive.vertices[i]), &(ndcVertices[i]));
-        }
-
-        // フェイスカリング
-        if (PrimitiveType::kTriangle == rasterPrimitive.primitiveType)
-        {
-            Vector3 p0(ndcVertices[0].ndcCoord.getXY(), 0.0f);
-            Vector3 p1(ndcVertices[1].ndcCoord.getXY(), 0.0f);
-            Vector3 p2(ndcVertices[2].ndcCoord.getXY(), 0.0f);
-
-            float n;
-            switch (_rasterizerState->frontFaceMode)
-            {
-            case FrontFaceMode::kCounterClockwise:
-                n = ((p1 - p0).cross(p2 - p0)).z;
-                break;
-            case FrontFaceMode::kClockwise:
-                n = ((p2 - p0).cross(p1 - p0)).z;
-                break;
-            default:
-                n = 0.0f;
-                break;
-            }
-
-            bool passed;
-            switch (_rasterizerState->cullFaceMode)
-            {
-            case CullFaceMode::kNone:
-                passed = true;
-                break;
-            case CullFaceMode::kBack:
-                passed = (0.0f < n);
-                break;
-            case CullFaceMode::kFront:
-                passed = (n < 0.0f);
-                break;
-            case CullFaceMode::kFrontAndBack:
-            default:
-                passed = false;
-                break;
-            }
-
-            if (!passed)
-            {
-                return;
-            }
-        }
-
-        // ビューポート変換
-        VertexDataD rasterVertices[3];
-        int rasterVertexNum = rasterPrimitive.vertexNum;
-        for (int i = 0; i < rasterVertexNum; i++)
-        {
-            applyViewportTransform(&(rasterPrimitive.vertices[i]), &(ndcVertices[i]), &rasterVertices[i]);
-        }
-
-        // 形状ごとの処理
-        switch (rasterVertexNum)
-        {
-        case 2:
-            rasterizeLine(&rasterVertices[0], &rasterVertices[1]);
-            break;
-        case 3:
-            constexpr bool wireframe = false;
-            if constexpr  (!wireframe)
-            {
-                rasterizeTriangle(&rasterVertices[0], &rasterVertices[1], &rasterVertices[2]);
-            }
-            else
-            {
-                rasterizeLine(&rasterVertices[0], &rasterVertices[1]);
-                rasterizeLine(&rasterVertices[1], &rasterVertices[2]);
-                rasterizeLine(&rasterVertices[2], &rasterVertices[0]);
-            }
-            break;
-        }
-    }
-
-
-    void RasterizeStage::rasterizeLine(const VertexDataD* p0, const VertexDataD* p1)
-    {
-        _rasterizer.begin();
-
-        constexpr bool opt = true;
-        if constexpr (opt)
-        {
-            _rasterizer.addEgde(&(p0->wndCoord), &(p1->wndCoord));
-        }
-        else
-        {
-            _rasterizer.addBoundingBox(&(p0->wndCoord), &(p1->wndCoord));
-        }
-
-        const Raster& _raster = *_rasterizer.getRaster();
-        for (int y = _raster.minY; y <= _raster.maxY; y += 2)
-        {
-            int y0 = y;
-            int y1 = y + 1;
-            int y1clamped = std::clamp(y1, _raster.minY, _raster.maxY);
-            int minX = std::min(_raster.scanlines[y0].minX, _raster.scanlines[y1clamped].minX);
-            int maxX = std::max(_raster.scanlines[y0].maxX, _raster.scanlines[y1clamped].maxX);
-            for (int x = minX; x <= maxX; x += 2)
-            {
-                int x0 = x;
-                int x1 = x + 1;
-                getLineFragment(x0, y0, p0, p1, &(_quadFragment->q00));
-                getLineFragment(x1, y0, p0, p1, &(_quadFragment->q01));
-                getLineFragment(x0, y1, p0, p1, &(_quadFragment->q10));
-                getLineFragment(x1, y1, p0, p1, &(_quadFragment->q11));
-                if (_quadFragment->q00.pixelCovered ||
-                    _quadFragment->q01.pixelCovered ||
-                    _quadFragment->q10.pixelCovered ||
-                    _quadFragment->q11.pixelCovered)
-                {
-                    _renderingContext->outputQuad();
-                }
-            }
-        }
-
-        _rasterizer.end();
-    }
-
-    void RasterizeStage::rasterizeTriangle(const VertexDataD* p0, const VertexDataD* p1, const VertexDataD* p2)
-    {
-        _sarea_abc = edgeFunction(p0->wndCoord, p1->wndCoord, p2->wndCoord);
-
-        _rasterizer.begin();
-
-        constexpr bool opt = true;
-        if constexpr (opt)
+        for (int j = 0; j < _varyingIndexState->activeVaryingNum; j++)
         {
-            _rasterizer.addEgde(&(p0->wndCoord), &(p1->wndCoord));
-            _rasterizer.addEgde(&(p1->wndCoord), &(p2->wndCoord));
-            _rasterizer.addEgde(&(p2->wndCoord), &(p0->wndCoord));
+            int i = _varyingIndexState->activeVaryingIndices[j];
+            wndVertex->varyingsDividedByW[i] = clipVertex->varyings[i] / clipVertex->clipCoord.w;
         }
-        else
-        {
-            _rasterizer.addBoundingBox(&(p0->wndCoord), &(p1->wndCoord), &(p2->wndCoord));
-        }
-
-        const Raster& _raster = *_rasterizer.getRaster();
-        for (int y = _raster.minY; y <= _raster.maxY; y += 2)
-        {
-            int y0 = y;
-            int y1 = y + 1;
-            int y1clamped = std::clamp(y1, _raster.minY, _raster.maxY);
-            int xmin = std::min(_raster.scanlines[y0].minX, _raster.scanlines[y1clamped].minX);
-            int xmax = std::max(_raster.scanlines[y0].maxX, _raster.scanlines[y1clamped].maxX);
-            for (int x = xmin; x <= xmax; x += 2)
-            {
-                int x0 = x;
-                int x1 = x + 1;
-                getTriangleFragment(x0, y0, p0, p1, p2, &(_quadFragment->q00));
-                getTriangleFragment(x1, y0, p0, p1, p2, &(_quadFragment->q01));
-                getTriangleFragment(x0, y1, p0, p1, p2, &(_quadFragment->q10));
-                getTriangleFragment(x1, y1, p0, p1, p2, &(_quadFragment->q11));
-                if (_quadFragment->q00.pixelCovered ||
-                    _quadFragment->q01.pixelCovered ||
-                    _quadFragment->q10.pixelCovered ||
-                    _quadFragment->q11.pixelCovered)
-                {
-                    _renderingContext->outputQuad();
-                }
-            }
-        }
-
-        _rasterizer.end();
     }
 
     bool CheckSegmentsIntersect(const Vector2& a, const Vector2& b, const Vector2& c, const Vector2& d)
@@ -343,7 +211,6 @@ namespace SoftwareRasterizer
         return true;
     }
 
-
     // intel gpu
     // slope = y / x
     bool DiamondSamplingRules(const Vector2 sample, float slope, const Vector2& point)
@@ -372,108 +239,4 @@ namespace SoftwareRasterizer
         return inisde;
     }
 
-    void RasterizeStage::getLineFragment(int x, int y, const VertexDataD* a, const VertexDataD* b, FragmentData* fragment)
-    {
-        fragment->pixelCoord = IntVector2(x, y);
-
-        // 菱形の各辺と交差判定
-        Vector2 diamondCorner0(x + 0.5f, y + 0.0f);
-        Vector2 diamondCorner1(x + 1.0f, y + 0.5f);
-        Vector2 diamondCorner2(x + 0.5f, y + 1.0f);
-        Vector2 diamondCorner3(x + 0.0f, y + 0.5f);
-        fragment->pixelCovered = false;
-        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner0, diamondCorner1))
-        {
-            fragment->pixelCovered = true;
-        }
-        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner1, diamondCorner2))
-        {
-            fragment->pixelCovered = true;
-        }
-        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner2, diamondCorner3))
-        {
-            fragment->pixelCovered = true;
-        }
-        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner3, diamondCorner0))
-        {
-            fragment->pixelCovered = true;
-        }
-
-        // ピクセルの中心
-        Vector2 p_wndCoord((float)x + 0.5f, (float)y + 0.5f);
-
-        // 線分上の最寄り位置を求める
-        Vector2 ab(b->wndCoord - a->wndCoord);
-        Vector2 ap(p_wndCoord - a->wndCoord);
-        float apLengthClosest = Vector2::Normalize(ab).dot(ap);
-        float t = apLengthClosest / ab.getNorm();
-        t = std::clamp(t, 0.0f, 1.0f);
-
-        VertexDataD p;
-        InterpolationUnit::InterpolateLinear(&p, a, b, t, _varyingIndexState);
-
-        assert(0.0f != p.invW);
-        float w = 1.0f / p.invW;
-
-        fragment->wndCoord = p.wndCoord;
-        fragment->depth = p.depth;
-        fragment->invW = p.invW;
-
-        for (int i = 0; i < kMaxVaryings; i++)
-        {
-            if (_varyingIndexState->enabledVaryingIndexBits & (1u << i))
-            {
-                fragment->varyings[i] = p.varyingsDividedByW[i] * w;
-            }
-        }
-    }
-
-    void RasterizeStage::getTriangleFragment(int x, int y, const VertexDataD* a, const VertexDataD* b, const VertexDataD* c, FragmentData* fragment)
-    {
-        fragment->pixelCoord = IntVector2(x, y);
-
-        // ピクセルの中心
-        Vector2 p_wndCoord(x + 0.5f, y + 0.5f);
-
-        // 重心座標
-        BarycentricCoord baryCoord;
-        assert(0.0f != _sarea_abc);
-        baryCoord.r1 = edgeFunction(b->wndCoord, c->wndCoord, p_wndCoord) / _sarea_abc;
-        baryCoord.r2 = edgeFunction(c->wndCoord, a->wndCoord, p_wndCoord) / _sarea_abc;
-        baryCoord.r3 = edgeFunction(a->wndCoord, b->wndCoord, p_wndCoord) / _sarea_abc;
-
-        // ピクセルの中心を内外判定
-        fragment->pixelCovered = true;
-        if (baryCoord.r1 < 0.0f)
-        {
-            fragment->pixelCovered = false;
-        }
-        if (baryCoord.r2 < 0.0f)
-        {
-            fragment->pixelCovered = false;
-        }
-        if (baryCoord.r3 < 0.0f)
-        {
-            fragment->pixelCovered = false;
-        }
-
-        VertexDataD p;
-        InterpolationUnit::InterpolateBarycentric(&p, a, b, c, &baryCoord, _varyingIndexState);
-
-        assert(0.0f != p.invW);
-        float w = 1.0f / p.invW;
-
-        fragment->wndCoord = p.wndCoord;
-        fragment->depth = p.depth;
-        fragment->invW = p.invW;
-
-        for (int i = 0; i < kMaxVaryings; i++)
-        {
-            if (_varyingIndexState->enabledVaryingIndexBits & (1u << i))
-            {
-                fragment->varyings[i] = p.varyingsDividedByW[i] * w;
-            }
-        }
-    }
-
 }
@@ -1,19 +1,30 @@
 ﻿#pragma once
 
 #include "..\Modules\Rasterizer.h"
+#include "..\Modules\InterpolationUnit.h"
+#include "..\Modules\DepthTileCompression.h"
 #include "..\State\WindowSize.h"
 #include "..\State\VaryingIndexState.h"
 #include "..\State\RasterizerState.h"
 #include "..\State\Viewport.h"
 #include "..\State\DepthRange.h"
 #include "..\Core\Types.h"
+#include <cassert>
+#include <algorithm>// min max clamp
+#include <iterator>// std::size
 
 namespace SoftwareRasterizer
 {
+    // ラスタライズしたクアッドの出力先（RenderingContext.h で定義）
+    template<class FragmentShader>
+    struct FragmentBackEnd;
+
+    bool CheckSegmentsIntersect(const Vector2& a, const Vector2& b, const Vector2& c, const Vector2& d);
+
     struct RasterPrimitive
     {
         PrimitiveType primitiveType;
-        VertexDataB vertices[3];
+        const VertexDataB* vertices[3];// クリップ結果の頂点を参照する
         int vertexNum;
     };
 
@@ -32,16 +43,30 @@ namespace SoftwareRasterizer
         void input(const RasterizerState* rasterizerState) { _rasterizerState = rasterizerState; }
         void input(const Viewport* viewport) { _viewport = viewport; }
         void input(const DepthRange* depthRange) { _depthRange = depthRange; }
+        void input(const DepthTileCompression* depthTileCompression) { _depthTileCompression = depthTileCompression; }
    
         void output(SubspanData* quadFragment) { _quadFragment = quadFragment; }
         void output(class RenderingContext* renderingContext) { _renderingContext = renderingContext; }
 
         void prepareRasterize();
+        void prepareViewportTransform();
+        // FragmentShader が void なら関数ポインタのシェーダ、それ以外は関数オブジェクトのシェーダをインライン展開する
+        template<class FragmentShader = void>
+        void prepareRasterizeKernel();
 
-        void rasterizePrimitive(RasterPrimitive& rasterPrimitive);
+        void rasterizePrimitive(const RasterPrimitive& rasterPrimitive) { (this->*_rasterizePrimitiveFunc)(rasterPrimitive); }
 
     private:
 
+        // 補間変数の数で特殊化する上限（超える場合は kDynamicVaryingNum のカーネルを使う）
+        static const int kSpecializedVaryingMaxNum = 4;
+
+        template<CullFaceMode CullMode, int VaryingNum, class FragmentShader>
+        void rasterizePrimitiveKernel(const RasterPrimitive& rasterPrimitive);
+
+        template<CullFaceMode CullMode>
+        bool cullFace(const VertexDataC* ndcVertices) const;
+
         void applyPerspectiveDivide(const VertexDataB* clipVertex, VertexDataC* ndcVertex);
 
         Vector2 transformNdcToWindowCoord(const VertexDataC* ndcVertex) const;
@@ -52,18 +77,21 @@ namespace SoftwareRasterizer
 
         float edgeFunction(const Vector2& a, const Vector2& b, const Vector2& c)
         {
-            // TODO：完全なエッジ関数
-            // 参考 Juan Pineda 1988 A Parallel Algorithm for Polygon Rasterization. 
-
-            Vector3 ab(b - a, 0.0f);
-            Vector3 ac(c - a, 0.0f);
-            return (ab.cross(ac)).z;
+            return InterpolationUnit::EdgeFunction(a, b, c);
         }
 
+        template<int VaryingNum, class FragmentShader>
         void rasterizeLine(const VertexDataD* p0, const VertexDataD* p1);
+        template<int VaryingNum, class FragmentShader>
         void rasterizeTriangle(const VertexDataD* rasterizationPoint0, const VertexDataD* rasterizationPoint1, const VertexDataD* rasterizationPopint2);
 
+        // 深度タイルを三角形でまとめて判定する（タイルがカリングされたら true）
+        bool beginDepthTiles(const VertexDataD* p0, const VertexDataD* p1, const VertexDataD* p2);
+        void finishDepthTiles();
+
+        template<int VaryingNum>
         void getLineFragment(int x, int y, const VertexDataD* p0, const VertexDataD* p1, FragmentData* fragment);
+        template<int VaryingNum>
         void getTriangleFragment(int x, int y, const VertexDataD* p0, const VertexDataD* p1, const VertexDataD* p2, FragmentData* fragment);
 
     private:
@@ -74,6 +102,7 @@ namespace SoftwareRasterizer
         const RasterizerState* _rasterizerState = nullptr;
         const Viewport* _viewport = nullptr;
         const DepthRange* _depthRange = nullptr;
+        const DepthTileCompression* _depthTileCompression = nullptr;
 
         // output
         SubspanData* _quadFragment;
@@ -86,9 +115,375 @@ namespace SoftwareRasterizer
         int _clipRectMaxX = 0;
         int _clipRectMaxY = 0;
 
+        // ビューポート変換の係数（prepareViewportTransform で作る）
+        Vector2 _viewportScale;
+        Vector2 _viewportOffset;
+
         Rasterizer _rasterizer;
 
         float _sarea_abc = 0.0f;// singed area 2x
 
+        // カリングモードと補間変数の数で特殊化したカーネル（prepareRasterizeKernel で選ぶ）
+        typedef void (RasterizeStage::*RasterizePrimitiveFuncPtr)(const RasterPrimitive& rasterPrimitive);
+        RasterizePrimitiveFuncPtr _rasterizePrimitiveFunc = nullptr;
+
     };
+
+    template<class FragmentShader>
+    void RasterizeStage::prepareRasterizeKernel()
+    {
+        // [CullFaceMode][補間変数の数]（最後の列は kDynamicVaryingNum）
+        static const RasterizePrimitiveFuncPtr kKernels[][kSpecializedVaryingMaxNum + 2] =
+        {
+            {
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, 0, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, 1, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, 2, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, 3, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, 4, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kNone, kDynamicVaryingNum, FragmentShader>,
+            },
+            {
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, 0, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, 1, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, 2, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, 3, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, 4, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFront, kDynamicVaryingNum, FragmentShader>,
+            },
+            {
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, 0, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, 1, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, 2, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, 3, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, 4, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kBack, kDynamicVaryingNum, FragmentShader>,
+            },
+            {
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, 0, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, 1, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, 2, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, 3, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, 4, FragmentShader>,
+                &RasterizeStage::rasterizePrimitiveKernel<CullFaceMode::kFrontAndBack, kDynamicVaryingNum, FragmentShader>,
+            },
+        };
+
+        int cullIndex = (int)_rasterizerState->cullFaceMode;
+        assert(0 <= cullIndex && cullIndex < std::size(kKernels));
+
+        int varyingNum = _varyingIndexState->activeVaryingNum;
+        int varyingIndex = (varyingNum <= kSpecializedVaryingMaxNum) ? varyingNum : (kSpecializedVaryingMaxNum + 1);
+
+        _rasterizePrimitiveFunc = kKernels[cullIndex][varyingIndex];
+    }
+
+    template<CullFaceMode CullMode>
+    bool RasterizeStage::cullFace(const VertexDataC* ndcVertices) const
+    {
+        if constexpr (CullFaceMode::kNone == CullMode)
+        {
+            return false;
+        }
+        else if constexpr (CullFaceMode::kFrontAndBack == CullMode)
+        {
+            return true;
+        }
+        else
+        {
+            Vector3 p0(ndcVertices[0].ndcCoord.getXY(), 0.0f);
+            Vector3 p1(ndcVertices[1].ndcCoord.getXY(), 0.0f);
+            Vector3 p2(ndcVertices[2].ndcCoord.getXY(), 0.0f);
+
+            float n;
+            switch (_rasterizerState->frontFaceMode)
+            {
+            case FrontFaceMode::kCounterClockwise:
+                n = ((p1 - p0).cross(p2 - p0)).z;
+                break;
+            case FrontFaceMode::kClockwise:
+                n = ((p2 - p0).cross(p1 - p0)).z;
+                break;
+            default:
+                n = 0.0f;
+                break;
+            }
+
+            if constexpr (CullFaceMode::kBack == CullMode)
+            {
+                return !(0.0f < n);
+            }
+            else
+            {
+                return !(n < 0.0f);
+            }
+        }
+    }
+
+    template<CullFaceMode CullMode, int VaryingNum, class FragmentShader>
+    void RasterizeStage::rasterizePrimitiveKernel(const RasterPrimitive& rasterPrimitive)
+    {
+        VertexDataC ndcVertices[3];
+        for (int i = 0; i < rasterPrimitive.vertexNum; i++)
+        {
+            applyPerspectiveDivide(rasterPrimitive.vertices[i], &(ndcVertices[i]));
+        }
+
+        // フェイスカリング
+        if (PrimitiveType::kTriangle == rasterPrimitive.primitiveType)
+        {
+            if (cullFace<CullMode>(ndcVertices))
+            {
+                return;
+            }
+        }
+
+        // ビューポート変換
+        VertexDataD rasterVertices[3];
+        int rasterVertexNum = rasterPrimitive.vertexNum;
+        for (int i = 0; i < rasterVertexNum; i++)
+        {
+            applyViewportTransform(rasterPrimitive.vertices[i], &(ndcVertices[i]), &rasterVertices[i]);
+        }
+
+        // 形状ごとの処理
+        switch (rasterVertexNum)
+        {
+        case 2:
+            rasterizeLine<VaryingNum, FragmentShader>(&rasterVertices[0], &rasterVertices[1]);
+            break;
+        case 3:
+            constexpr bool wireframe = false;
+            if constexpr  (!wireframe)
+            {
+                rasterizeTriangle<VaryingNum, FragmentShader>(&rasterVertices[0], &rasterVertices[1], &rasterVertices[2]);
+            }
+            else
+            {
+                rasterizeLine<VaryingNum, FragmentShader>(&rasterVertices[0], &rasterVertices[1]);
+                rasterizeLine<VaryingNum, FragmentShader>(&rasterVertices[1], &rasterVertices[2]);
+                rasterizeLine<VaryingNum, FragmentShader>(&rasterVertices[2], &rasterVertices[0]);
+            }
+            break;
+        }
+    }
+
+    template<int VaryingNum, class FragmentShader>
+    void RasterizeStage::rasterizeLine(const VertexDataD* p0, const VertexDataD* p1)
+    {
+        _rasterizer.begin();
+
+        constexpr bool opt = true;
+        if constexpr (opt)
+        {
+            _rasterizer.addEgde(&(p0->wndCoord), &(p1->wndCoord));
+        }
+        else
+        {
+            _rasterizer.addBoundingBox(&(p0->wndCoord), &(p1->wndCoord));
+        }
+
+        const Raster& _raster = *_rasterizer.getRaster();
+        for (int y = _raster.minY; y <= _raster.maxY; y += 2)
+        {
+            int y0 = y;
+            int y1 = y + 1;
+            int y1clamped = std::clamp(y1, _raster.minY, _raster.maxY);
+            int minX = std::min(_raster.scanlines[y0].minX, _raster.scanlines[y1clamped].minX);
+            int maxX = std::max(_raster.scanlines[y0].maxX, _raster.scanlines[y1clamped].maxX);
+            for (int x = minX; x <= maxX; x += 2)
+            {
+                int x0 = x;
+                int x1 = x + 1;
+                getLineFragment<VaryingNum>(x0, y0, p0, p1, &(_quadFragment->q00));
+                getLineFragment<VaryingNum>(x1, y0, p0, p1, &(_quadFragment->q01));
+                getLineFragment<VaryingNum>(x0, y1, p0, p1, &(_quadFragment->q10));
+                getLineFragment<VaryingNum>(x1, y1, p0, p1, &(_quadFragment->q11));
+                if (_quadFragment->q00.pixelCovered ||
+                    _quadFragment->q01.pixelCovered ||
+                    _quadFragment->q10.pixelCovered ||
+                    _quadFragment->q11.pixelCovered)
+                {
+                    FragmentBackEnd<FragmentShader>::outputQuad(_renderingContext);
+                }
+            }
+        }
+
+        _rasterizer.end();
+    }
+
+    template<int VaryingNum, class FragmentShader>
+    void RasterizeStage::rasterizeTriangle(const VertexDataD* p0, const VertexDataD* p1, const VertexDataD* p2)
+    {
+        _sarea_abc = edgeFunction(p0->wndCoord, p1->wndCoord, p2->wndCoord);
+
+        _rasterizer.begin();
+
+        constexpr bool opt = true;
+        if constexpr (opt)
+        {
+            _rasterizer.addEgde(&(p0->wndCoord), &(p1->wndCoord));
+            _rasterizer.addEgde(&(p1->wndCoord), &(p2->wndCoord));
+            _rasterizer.addEgde(&(p2->wndCoord), &(p0->wndCoord));
+        }
+        else
+        {
+            _rasterizer.addBoundingBox(&(p0->wndCoord), &(p1->wndCoord), &(p2->wndCoord));
+        }
+
+        bool depthTilesCulled = beginDepthTiles(p0, p1, p2);
+
+        const Raster& _raster = *_rasterizer.getRaster();
+        for (int y = _raster.minY; y <= _raster.maxY; y += 2)
+        {
+            int y0 = y;
+            int y1 = y + 1;
+            int y1clamped = std::clamp(y1, _raster.minY, _raster.maxY);
+            int xmin = std::min(_raster.scanlines[y0].minX, _raster.scanlines[y1clamped].minX);
+            int xmax = std::max(_raster.scanlines[y0].maxX, _raster.scanlines[y1clamped].maxX);
+            for (int x = xmin; x <= xmax; x += 2)
+            {
+                int x0 = x;
+                int x1 = x + 1;
+
+                // 深度テストにすべて失敗するタイルのピクセルは捨てる
+                bool culled00 = false;
+                bool culled01 = false;
+                bool culled10 = false;
+                bool culled11 = false;
+                if (depthTilesCulled)
+                {
+                    culled00 = _depthTileCompression->isCulled(x0, y0);
+                    culled01 = _depthTileCompression->isCulled(x1, y0);
+                    culled10 = _depthTileCompression->isCulled(x0, y1);
+                    culled11 = _depthTileCompression->isCulled(x1, y1);
+                    if (culled00 && culled01 && culled10 && culled11)
+                    {
+                        continue;
+                    }
+                }
+
+                getTriangleFragment<VaryingNum>(x0, y0, p0, p1, p2, &(_quadFragment->q00));
+                getTriangleFragment<VaryingNum>(x1, y0, p0, p1, p2, &(_quadFragment->q01));
+                getTriangleFragment<VaryingNum>(x0, y1, p0, p1, p2, &(_quadFragment->q10));
+                getTriangleFragment<VaryingNum>(x1, y1, p0, p1, p2, &(_quadFragment->q11));
+                _quadFragment->q00.pixelCovered &= !culled00;
+                _quadFragment->q01.pixelCovered &= !culled01;
+                _quadFragment->q10.pixelCovered &= !culled10;
+                _quadFragment->q11.pixelCovered &= !culled11;
+                if (_quadFragment->q00.pixelCovered ||
+                    _quadFragment->q01.pixelCovered ||
+                    _quadFragment->q10.pixelCovered ||
+                    _quadFragment->q11.pixelCovered)
+                {
+                    FragmentBackEnd<FragmentShader>::outputQuad(_renderingContext);
+                }
+            }
+        }
+
+        finishDepthTiles();
+
+        _rasterizer.end();
+    }
+
+    template<int VaryingNum>
+    void RasterizeStage::getLineFragment(int x, int y, const VertexDataD* a, const VertexDataD* b, FragmentData* fragment)
+    {
+        fragment->pixelCoord = IntVector2(x, y);
+
+        // 菱形の各辺と交差判定
+        Vector2 diamondCorner0(x + 0.5f, y + 0.0f);
+        Vector2 diamondCorner1(x + 1.0f, y + 0.5f);
+        Vector2 diamondCorner2(x + 0.5f, y + 1.0f);
+        Vector2 diamondCorner3(x + 0.0f, y + 0.5f);
+        fragment->pixelCovered = false;
+        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner0, diamondCorner1))
+        {
+            fragment->pixelCovered = true;
+        }
+        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner1, diamondCorner2))
+        {
+            fragment->pixelCovered = true;
+        }
+        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner2, diamondCorner3))
+        {
+            fragment->pixelCovered = true;
+        }
+        if (CheckSegmentsIntersect(a->wndCoord, b->wndCoord, diamondCorner3, diamondCorner0))
+        {
+            fragment->pixelCovered = true;
+        }
+
+        // ピクセルの中心
+        Vector2 p_wndCoord((float)x + 0.5f, (float)y + 0.5f);
+
+        // 線分上の最寄り位置を求める
+        Vector2 ab(b->wndCoord - a->wndCoord);
+        Vector2 ap(p_wndCoord - a->wndCoord);
+        float apLengthClosest = Vector2::Normalize(ab).dot(ap);
+        float t = apLengthClosest / ab.getNorm();
+        t = std::clamp(t, 0.0f, 1.0f);
+
+        VertexDataD p;
+        InterpolationUnit::InterpolateLinear<VaryingNum>(&p, a, b, t, _varyingIndexState);
+
+        assert(0.0f != p.invW);
+        float w = 1.0f / p.invW;
+
+        fragment->wndCoord = p.wndCoord;
+        fragment->depth = p.depth;
+        fragment->invW = p.invW;
+
+        const int varyingNum = (kDynamicVaryingNum == VaryingNum) ? _varyingIndexState->activeVaryingNum : VaryingNum;
+        for (int j = 0; j < varyingNum; j++)
+        {
+            int i = _varyingIndexState->activeVaryingIndices[j];
+            fragment->varyings[i] = p.varyingsDividedByW[i] * w;
+        }
+    }
+
+    template<int VaryingNum>
+    void RasterizeStage::getTriangleFragment(int x, int y, const VertexDataD* a, const VertexDataD* b, const VertexDataD* c, FragmentData* fragment)
+    {
+        fragment->pixelCoord = IntVector2(x, y);
+
+        // ピクセルの中心
+        Vector2 p_wndCoord(x + 0.5f, y + 0.5f);
+
+        // 重心座標
+        assert(0.0f != _sarea_abc);
+        BarycentricCoord baryCoord = InterpolationUnit::ComputeBarycentricCoord(a->wndCoord, b->wndCoord, c->wndCoord, _sarea_abc, p_wndCoord);
+
+        // ピクセルの中心を内外判定
+        fragment->pixelCovered = true;
+        if (baryCoord.r1 < 0.0f)
+        {
+            fragment->pixelCovered = false;
+        }
+        if (baryCoord.r2 < 0.0f)
+        {
+            fragment->pixelCovered = false;
+        }
+        if (baryCoord.r3 < 0.0f)
+        {
+            fragment->pixelCovered = false;
+        }
+
+        VertexDataD p;
+        InterpolationUnit::InterpolateBarycentric<VaryingNum>(&p, a, b, c, &baryCoord, _varyingIndexState);
+
+        assert(0.0f != p.invW);
+        float w = 1.0f / p.invW;
+
+        fragment->wndCoord = p.wndCoord;
+        fragment->depth = p.depth;
+        fragment->invW = p.invW;
+
+        const int varyingNum = (kDynamicVaryingNum == VaryingNum) ? _varyingIndexState->activeVaryingNum : VaryingNum;
+        for (int j = 0; j < varyingNum; j++)
+        {
+            int i = _varyingIndexState->activeVaryingIndices[j];
+            fragment->varyings[i] = p.varyingsDividedByW[i] * w;
+        }
+    }
 }
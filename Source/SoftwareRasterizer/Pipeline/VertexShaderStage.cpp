@@ -1,4 +1,5 @@
 ﻿#include "VertexShaderStage.h"
+#include "..\Modules\ClipStage.h"
 #include <cassert>
 
 namespace SoftwareRasterizer
@@ -6,7 +7,7 @@ namespace SoftwareRasterizer
     void VertexShaderStage::validateState(const VertexShaderProgram* state)
     {
         //assert(state->uniformBlock);
-        assert(state->vertexShaderMain);
+        assert(state->vertexShaderMain || state->vertexShaderObjectMain);
     }
 
     VertexShaderStage::VertexShaderStage()
@@ -19,12 +20,84 @@ namespace SoftwareRasterizer
         vertexShaderInput.uniformBlock = _constantBuffer->uniformBlock;
         vertexShaderInput.attributes = inputVertex->attributes;
         vertexShaderInput.vertexId = inputVertex->vertexId;
+        vertexShaderInput.instanceId = inputVertex->instanceId;
 
         VertexShaderOutput vertexShaderOutput;
         vertexShaderOutput.varyings = outputVertex->varyings;
 
-        _vertexShaderProgram->vertexShaderMain(&vertexShaderInput, &vertexShaderOutput);
+        if (_vertexShaderProgram->vertexShaderObjectMain)
+        {
+            _vertexShaderProgram->vertexShaderObjectMain(_vertexShaderProgram->vertexShaderObject, &vertexShaderInput, &vertexShaderOutput);
+        }
+        else
+        {
+            _vertexShaderProgram->vertexShaderMain(&vertexShaderInput, &vertexShaderOutput);
+        }
 
         outputVertex->clipCoord = vertexShaderOutput.position;
+        outputVertex->outcode = ClipStage::ComputeOutcode(outputVertex->clipCoord);
+    }
+
+    void VertexShaderStage::executeBatchShader(const VertexDataA* const* inputVertices, VertexDataB* const* outputVertices, int vertexNum, VertexBatchData* vertexBatch) const
+    {
+        assert(_vertexShaderProgram->vertexBatchShaderMain);
+        assert(0 < vertexNum && vertexNum <= kVertexBatchMaxSize);
+
+        // AoS -> SoA（有効な頂点属性のみ）
+        for (int lane = 0; lane < vertexNum; lane++)
+        {
+            const VertexDataA* inputVertex = inputVertices[lane];
+            vertexBatch->vertexIds[lane] = inputVertex->vertexId;
+            for (int i = 0; i < kMaxVertexAttributes; i++)
+            {
+                if (_inputLayout->enabledVertexAttributeIndexBits & (1u << i))
+                {
+                    const Vector4& attribute = inputVertex->attributes[i];
+                    vertexBatch->attributes[i][0][lane] = attribute.x;
+                    vertexBatch->attributes[i][1][lane] = attribute.y;
+                    vertexBatch->attributes[i][2][lane] = attribute.z;
+                    vertexBatch->attributes[i][3][lane] = attribute.w;
+                }
+            }
+        }
+        vertexBatch->vertexNum = vertexNum;
+
+        VertexBatchShaderInput vertexShaderInput;
+        vertexShaderInput.uniformBlock = _constantBuffer->uniformBlock;
+        vertexShaderInput.vertexNum = vertexNum;
+        vertexShaderInput.vertexIds = vertexBatch->vertexIds;
+        vertexShaderInput.instanceId = inputVertices[0]->instanceId;// バッチは同じインスタンスの頂点だけで組む
+        vertexShaderInput.attributes = vertexBatch->attributes;
+
+        VertexBatchShaderOutput vertexShaderOutput;
+        vertexShaderOutput.position = vertexBatch->clipCoord;
+        vertexShaderOutput.varyings = vertexBatch->varyings;
+
+        _vertexShaderProgram->vertexBatchShaderMain(&vertexShaderInput, &vertexShaderOutput);
+
+        ClipStage::ComputeOutcodes(vertexBatch->clipCoord, vertexNum, vertexBatch->outcodes);
+
+        // SoA -> AoS（有効な補間変数のみ）
+        for (int lane = 0; lane < vertexNum; lane++)
+        {
+            VertexDataB* outputVertex = outputVertices[lane];
+            outputVertex->clipCoord = Vector4(
+                vertexBatch->clipCoord[0][lane],
+                vertexBatch->clipCoord[1][lane],
+                vertexBatch->clipCoord[2][lane],
+                vertexBatch->clipCoord[3][lane]
+            );
+            outputVertex->outcode = vertexBatch->outcodes[lane];
+            for (int j = 0; j < _varyingIndexState->activeVaryingNum; j++)
+            {
+                int i = _varyingIndexState->activeVaryingIndices[j];
+                outputVertex->varyings[i] = Vector4(
+                    vertexBatch->varyings[i][0][lane],
+                    vertexBatch->varyings[i][1][lane],
+                    vertexBatch->varyings[i][2][lane],
+                    vertexBatch->varyings[i][3][lane]
+                );
+            }
+        }
     }
 }
@@ -2,6 +2,8 @@
 
 #include "..\State\VertexShaderProgram.h"
 #include "..\State\ConstantBuffer.h"
+#include "..\State\InputLayout.h"
+#include "..\State\VaryingIndexState.h"
 #include "..\Core\Types.h"
 
 namespace SoftwareRasterizer
@@ -17,14 +19,21 @@ namespace SoftwareRasterizer
 
         void input(const ConstantBuffer* constantBuffer) { _constantBuffer = constantBuffer; }
         void input(const VertexShaderProgram* vertexShaderProgram) { _vertexShaderProgram = vertexShaderProgram; }
+        void input(const InputLayout* inputLayout) { _inputLayout = inputLayout; }
+        void input(const VaryingIndexState* varyingIndexState) { _varyingIndexState = varyingIndexState; }
 
         void executeShader(const VertexDataA* inputVertex, VertexDataB* outputVertex) const;
 
+        // vertexBatch は作業領域（スレッドごとに用意すれば並列に呼び出せる）
+        void executeBatchShader(const VertexDataA* const* inputVertices, VertexDataB* const* outputVertices, int vertexNum, VertexBatchData* vertexBatch) const;
+
     private:
 
         // input
         const ConstantBuffer* _constantBuffer;
         const VertexShaderProgram* _vertexShaderProgram;
+        const InputLayout* _inputLayout = nullptr;
+        const VaryingIndexState* _varyingIndexState = nullptr;
 
         // output
         // TODO:
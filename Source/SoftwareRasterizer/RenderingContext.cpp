@@ -3,7 +3,6 @@
 #include "Pipeline\VertexShaderStage.h"
 #include "Pipeline\RasterizeStage.h"
 #include "Pipeline\FragmentShaderStage.h"
-#include "Modules\ClipStage.h"
 #include "Modules\PrimitiveAssembly.h"
 #include "Modules\TextureOperations.h" 
 #include <iterator>// std::size
@@ -14,12 +13,15 @@ namespace SoftwareRasterizer
 {
     RenderingContext::RenderingContext()
     {
+        // 各ステージの入出力はすべて自身のメンバを指すので、接続は一度だけでよい
+        bindStages();
     }
 
     void RenderingContext::setWindowSize(int width, int height)
     {
         _windowSize.windowWidth = width;
         _windowSize.windowHeight = height;
+        _dirtyStateBits |= kDirtyClipRect;
     }
 
     int RenderingContext::getWindowWidth() const
@@ -37,21 +39,69 @@ namespace SoftwareRasterizer
         assert(0 <= width);
         assert(0 <= height);
         assert(width <= widthBytes);
-        _renderTarget.colorBuffer.addr = addr;
+        _renderTarget.resolveBuffer.addr = addr;
+        _renderTarget.resolveBuffer.width = width;
+        _renderTarget.resolveBuffer.height = height;
+        _renderTarget.resolveBuffer.widthBytes = widthBytes;
+        _renderTarget.resolveBuffer.layout = TextureLayout::kLinear;
+
+        // 同じサイズのタイル配置のカラーと深度を確保
+        int tileNumX = (width + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileNumY = (height + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        _colorTiles.resize((size_t)tileNumX * tileNumY);
+
+        _renderTarget.colorBuffer.addr = _colorTiles.data();
         _renderTarget.colorBuffer.width = width;
         _renderTarget.colorBuffer.height = height;
-        _renderTarget.colorBuffer.widthBytes = widthBytes;
+        _renderTarget.colorBuffer.widthBytes = tileNumX * (int)sizeof(RenderTargetTile);
+        _renderTarget.colorBuffer.layout = TextureLayout::kTiled;
+        _colorTileClear.configure(width, height);
+
+        allocateDepthTiles();
     }
 
-    void RenderingContext::setRenderTargetDepthBuffer(void* addr, int width, int height, int widthBytes)
+    void RenderingContext::setDepthFormat(DepthFormat depthFormat)
     {
-        assert(0 <= width);
-        assert(0 <= height);
-        assert(width <= widthBytes);
-        _renderTarget.depthBuffer.addr = addr;
+        if (_renderTarget.depthFormat == depthFormat)
+        {
+            return;
+        }
+
+        _renderTarget.depthFormat = depthFormat;
+        allocateDepthTiles();
+        _dirtyStateBits |= kDirtyDepthState;
+    }
+
+    void RenderingContext::allocateDepthTiles()
+    {
+        int width = _renderTarget.colorBuffer.width;
+        int height = _renderTarget.colorBuffer.height;
+        int tileNumX = (width + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+        int tileNumY = (height + kTextureTileSize - 1) >> kTextureTileSizeLog2;
+
+        // D16 はタイル１枚が半分の大きさになる
+        size_t texelBytes = TextureOperations::GetDepthTexelBytes(_renderTarget.depthFormat);
+        size_t tileRowBytes = texelBytes * kTextureTileTexelNum * tileNumX;
+        _depthTiles.resize(((tileRowBytes * tileNumY) + sizeof(RenderTargetTile) - 1) / sizeof(RenderTargetTile));
+
+        _renderTarget.depthBuffer.addr = _depthTiles.data();
         _renderTarget.depthBuffer.width = width;
         _renderTarget.depthBuffer.height = height;
-        _renderTarget.depthBuffer.widthBytes = widthBytes;
+        _renderTarget.depthBuffer.widthBytes = (int)tileRowBytes;
+        _renderTarget.depthBuffer.layout = TextureLayout::kTiled;
+
+        _depthTileCompression.configure(width, height);
+    }
+
+    void RenderingContext::resolveRenderTarget()
+    {
+        if (nullptr == _renderTarget.resolveBuffer.addr)
+        {
+            return;
+        }
+
+        // 一度も書き込まれていないタイルはクリア値を直接書き出す
+        TextureOperations::ResolveTexture(&(_renderTarget.colorBuffer), &(_renderTarget.resolveBuffer), _colorTileClear.getClearedTiles(), _colorTileClear.getClearColor());
     }
 
     void RenderingContext::setClearColor(float red, float green, float blue, float alpha)
@@ -76,8 +126,9 @@ namespace SoftwareRasterizer
             _clearParam.clearColorA
         );
         float depth = _clearParam.clearDepth;
-        TextureOperations::FillTextureColor(&(_renderTarget.colorBuffer), color);
-        TextureOperations::FillTextureDepth(&(_renderTarget.depthBuffer), depth);
+        // どちらもタイルに印を付けるだけでテクセルには書き込まない
+        _colorTileClear.clear(color);
+        _depthTileCompression.clear(depth);
     }
 
     void RenderingContext::setUniformBlock(const void* uniformBlock)
@@ -108,25 +159,77 @@ namespace SoftwareRasterizer
         vertexBuffer->addr = buffer;
     }
 
+    void RenderingContext::setVertexAttributeDivisor(int index, int divisor)
+    {
+        assert(0 <= index && index < std::size(_inputLayout.elements));
+        assert(0 <= divisor);
+        _inputLayout.elements[index].divisor = divisor;
+    }
+
     void RenderingContext::setIndexBuffer(const uint16_t* indices, int indexNum)
     {
         _indexBuffer.indices = indices;
+        _indexBuffer.indexType = IndexType::kUnsignedShort;
+        _indexBuffer.indexNum = indexNum;
+    }
+
+    void RenderingContext::setIndexBuffer(const uint32_t* indices, int indexNum)
+    {
+        _indexBuffer.indices = indices;
+        _indexBuffer.indexType = IndexType::kUnsignedInt;
         _indexBuffer.indexNum = indexNum;
     }
 
+    void RenderingContext::enablePrimitiveRestart()
+    {
+        _indexBuffer.primitiveRestartEnabled = true;
+    }
+
+    void RenderingContext::disablePrimitiveRestart()
+    {
+        _indexBuffer.primitiveRestartEnabled = false;
+    }
+
     void RenderingContext::enableVarying(int index)
     {
         _varyingIndexState.enabledVaryingIndexBits |= (1u << index);
+        _dirtyStateBits |= kDirtyVaryingIndex;
     }
 
     void RenderingContext::disableVarying(int index)
     {
         _varyingIndexState.enabledVaryingIndexBits &= ~(1u << index);
+        _dirtyStateBits |= kDirtyVaryingIndex;
+    }
+
+    void RenderingContext::setVertexCacheSize(int entryNum)
+    {
+        assert(kVertexCacheMinEntryNum <= entryNum && entryNum <= kVertexCacheMaxEntryNum);
+        _vertexCacheState.entryNum = entryNum;
+        _dirtyStateBits |= kDirtyVertexCache;
+    }
+
+    void RenderingContext::setVertexCacheReplacementPolicy(VertexCacheReplacementPolicy replacementPolicy)
+    {
+        _vertexCacheState.replacementPolicy = replacementPolicy;
+        _dirtyStateBits |= kDirtyVertexCache;
+    }
+
+    void RenderingContext::setVertexProcessingMode(VertexProcessingMode vertexProcessingMode)
+    {
+        _vertexProcessingState.vertexProcessingMode = vertexProcessingMode;
+    }
+
+    void RenderingContext::setVertexProcessingThreadNum(int threadNum)
+    {
+        assert(0 <= threadNum);
+        _vertexProcessingState.threadNum = threadNum;
     }
 
-    void RenderingContext::setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain)
+    void RenderingContext::setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain, VertexBatchShaderFuncPtr vertexBatchShaderMain)
     {
         _vertexShaderProgram.vertexShaderMain = vertexShaderMain;
+        _vertexShaderProgram.vertexBatchShaderMain = vertexBatchShaderMain;
     }
 
     void RenderingContext::setViewport(int x, int y, int width, int height)
@@ -135,6 +238,7 @@ namespace SoftwareRasterizer
         _viewport.viewportY = y;
         _viewport.viewportWidth = width;
         _viewport.viewportHeight = height;
+        _dirtyStateBits |= (kDirtyClipRect | kDirtyViewport);
     }
 
     int RenderingContext::getViewportWidth() const
@@ -151,6 +255,7 @@ namespace SoftwareRasterizer
     {
         _depthRange.depthRangeNearVal = nearVal;
         _depthRange.depthRangeFarVal = farVal;
+        _dirtyStateBits |= kDirtyDepthRange;
     }
 
     void RenderingContext::setFrontFaceMode(FrontFaceMode frontFaceMode)
@@ -161,30 +266,212 @@ namespace SoftwareRasterizer
     void RenderingContext::setCullFaceMode(CullFaceMode cullFaceMode)
     {
         _rasterizerState.cullFaceMode = cullFaceMode;
+        _dirtyStateBits |= kDirtyRasterizerState;
     }
 
-    void RenderingContext::setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain)
+    void RenderingContext::setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain, FragmentBatchShaderFuncPtr fragmentBatchShaderMain)
     {
         _fragmentShaderProgram.fragmentShaderMain = fragmentShaderMain;
+        _fragmentShaderProgram.fragmentBatchShaderMain = fragmentBatchShaderMain;
     }
 
     void RenderingContext::setDepthFunc(ComparisonFunc depthFunc)
     {
         _depthState.depthFunc = depthFunc;
+        _dirtyStateBits |= kDirtyDepthState;
     }
 
     void RenderingContext::drawIndexed(PrimitiveTopologyType primitiveTopologyType)
+    {
+        drawIndexedBaseVertex(primitiveTopologyType, 0, _indexBuffer.indexNum, 0);
+    }
+
+    void RenderingContext::drawIndexedBaseVertex(PrimitiveTopologyType primitiveTopologyType, int first, int count, int baseVertex)
+    {
+        assert(0 <= first && 0 <= count);
+        assert((first + count) <= _indexBuffer.indexNum);
+
+        DrawParam drawParam;
+        drawParam.primitiveTopologyType = primitiveTopologyType;
+        drawParam.indexed = true;
+        drawParam.first = first;
+        drawParam.count = count;
+        drawParam.baseVertex = baseVertex;
+        draw(drawParam);
+    }
+
+    void RenderingContext::drawArrays(PrimitiveTopologyType primitiveTopologyType, int first, int count)
+    {
+        assert(0 <= first && 0 <= count);
+
+        DrawParam drawParam;
+        drawParam.primitiveTopologyType = primitiveTopologyType;
+        drawParam.indexed = false;
+        drawParam.first = first;
+        drawParam.count = count;
+        drawParam.baseVertex = 0;
+        draw(drawParam);
+    }
+
+    void RenderingContext::drawIndexedInstanced(PrimitiveTopologyType primitiveTopologyType, int instanceCount)
+    {
+        assert(0 <= instanceCount);
+
+        DrawParam drawParam;
+        drawParam.primitiveTopologyType = primitiveTopologyType;
+        drawParam.indexed = true;
+        drawParam.first = 0;
+        drawParam.count = _indexBuffer.indexNum;
+        drawParam.baseVertex = 0;
+        drawParam.instanceCount = instanceCount;
+        draw(drawParam);
+    }
+
+    void RenderingContext::multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount)
+    {
+        assert(0 <= drawCount);
+
+        // 引数を読みながら連続して描画する
+        DrawParam drawParam;
+        drawParam.primitiveTopologyType = primitiveTopologyType;
+        drawParam.indexed = true;
+        for (int i = 0; i < drawCount; i++)
+        {
+            const DrawIndexedIndirectCommand* command = &(commands[i]);
+            assert(0 <= command->firstIndex && 0 <= command->indexCount);
+            assert((command->firstIndex + command->indexCount) <= _indexBuffer.indexNum);
+            assert(0 <= command->instanceCount);
+
+            // カリング等で空にされた描画は飛ばす
+            if ((0 == command->indexCount) || (0 == command->instanceCount))
+            {
+                continue;
+            }
+
+            drawParam.first = command->firstIndex;
+            drawParam.count = command->indexCount;
+            drawParam.baseVertex = command->baseVertex;
+            drawParam.instanceCount = command->instanceCount;
+            draw(drawParam);
+        }
+    }
+
+    void RenderingContext::executeCommandBuffer(const CommandBuffer* commandBuffer)
+    {
+        // 引数は記録時に検証済みなので、そのまま状態に反映して描画する
+        const Command* commands = commandBuffer->getCommands();
+        int commandNum = commandBuffer->getCommandNum();
+        for (int i = 0; i < commandNum; i++)
+        {
+            const Command* command = &(commands[i]);
+            switch (command->type)
+            {
+            case CommandType::kClearRenderTarget:
+                setClearColor(command->clear.color[0], command->clear.color[1], command->clear.color[2], command->clear.color[3]);
+                setClearDepth(command->clear.depth);
+                clearRenderTarget();
+                break;
+            case CommandType::kSetUniformBlock:
+                setUniformBlock(command->uniformBlock);
+                break;
+            case CommandType::kEnableVertexAttribute:
+                enableVertexAttribute(command->index);
+                break;
+            case CommandType::kDisableVertexAttribute:
+                disableVertexAttribute(command->index);
+                break;
+            case CommandType::kSetVertexAttribute:
+                setVertexAttribute(
+                    command->vertexAttribute.index,
+                    command->vertexAttribute.size,
+                    command->vertexAttribute.type,
+                    command->vertexAttribute.stride,
+                    command->vertexAttribute.buffer);
+                break;
+            case CommandType::kSetVertexAttributeDivisor:
+                setVertexAttributeDivisor(command->vertexAttributeDivisor.index, command->vertexAttributeDivisor.divisor);
+                break;
+            case CommandType::kSetIndexBuffer:
+                _indexBuffer.indices = command->indexBuffer.indices;
+                _indexBuffer.indexType = command->indexBuffer.indexType;
+                _indexBuffer.indexNum = command->indexBuffer.indexNum;
+                break;
+            case CommandType::kSetPrimitiveRestart:
+                _indexBuffer.primitiveRestartEnabled = command->primitiveRestartEnabled;
+                break;
+            case CommandType::kEnableVarying:
+                enableVarying(command->index);
+                break;
+            case CommandType::kDisableVarying:
+                disableVarying(command->index);
+                break;
+            case CommandType::kSetVertexProcessingMode:
+                setVertexProcessingMode(command->vertexProcessingMode);
+                break;
+            case CommandType::kSetVertexShaderProgram:
+                setVertexShaderProgram(command->vertexShaderProgram.vertexShaderMain, command->vertexShaderProgram.vertexBatchShaderMain);
+                break;
+            case CommandType::kSetViewport:
+                setViewport(command->viewport.x, command->viewport.y, command->viewport.width, command->viewport.height);
+                break;
+            case CommandType::kSetDepthRange:
+                setDepthRange(command->depthRange.nearVal, command->depthRange.farVal);
+                break;
+            case CommandType::kSetFrontFaceMode:
+                setFrontFaceMode(command->frontFaceMode);
+                break;
+            case CommandType::kSetCullFaceMode:
+                setCullFaceMode(command->cullFaceMode);
+                break;
+            case CommandType::kSetFragmentShaderProgram:
+                setFragmentShaderProgram(command->fragmentShaderProgram.fragmentShaderMain, command->fragmentShaderProgram.fragmentBatchShaderMain);
+                break;
+            case CommandType::kSetDepthFunc:
+                setDepthFunc(command->depthFunc);
+                break;
+            case CommandType::kDraw:
+                {
+                    DrawParam drawParam;
+                    drawParam.primitiveTopologyType = command->draw.primitiveTopologyType;
+                    drawParam.indexed = command->draw.indexed;
+                    drawParam.first = command->draw.first;
+                    drawParam.count = command->draw.count;
+                    drawParam.baseVertex = command->draw.baseVertex;
+                    drawParam.instanceCount = command->draw.instanceCount;
+                    draw(drawParam);
+                }
+                break;
+            case CommandType::kDrawIndexedIndirect:
+                multiDrawIndexedIndirect(command->drawIndirect.primitiveTopologyType, command->drawIndirect.commands, command->drawIndirect.drawCount);
+                break;
+            default:
+                assert(false);
+                break;
+            }
+        }
+    }
+
+    void RenderingContext::bindStages()
     {
         // Set IA I/O.
         _inputAssemblyStage.input(&_inputLayout);
         _inputAssemblyStage.input(&_vertexBuffers);
         _inputAssemblyStage.input(&_indexBuffer);
-        _inputAssemblyStage.input(primitiveTopologyType);
+        _inputAssemblyStage.input(&_drawParam);
+        _inputAssemblyStage.input(&_vertexShaderProgram);
+        _inputAssemblyStage.input(&_vertexProcessingState);
+        _inputAssemblyStage.output(&_vertexCache);
+        _inputAssemblyStage.output(&_transientAllocator);
         _inputAssemblyStage.output(this);
 
         // Set VS I/O.
         _vertexShaderStage.input(&_constantBuffer);
         _vertexShaderStage.input(&_vertexShaderProgram);
+        _vertexShaderStage.input(&_inputLayout);
+        _vertexShaderStage.input(&_varyingIndexState);
+
+        // Set clipper I/O.
+        _clipStage.setVaryingEnabledBits(&_varyingIndexState);
 
         // Set RS I/O.
         _rasterizeStage.input(&_windowSize);
@@ -192,6 +479,7 @@ namespace SoftwareRasterizer
         _rasterizeStage.input(&_rasterizerState);
         _rasterizeStage.input(&_viewport);
         _rasterizeStage.input(&_depthRange);
+        _rasterizeStage.input(&_depthTileCompression);
         _rasterizeStage.output(&_quadFragment);
         _rasterizeStage.output(this);
 
@@ -199,49 +487,119 @@ namespace SoftwareRasterizer
         _fragmentShaderStage.input(&_constantBuffer);
         _fragmentShaderStage.input(&_fragmentShaderProgram);
         _fragmentShaderStage.input(&_quadFragment);
+        _fragmentShaderStage.input(&_fragmentBatch);
         _fragmentShaderStage.output(&_quadPixel);
+        _fragmentShaderStage.output(&_pixelBatch);
 
         // Set OM I/O.
         _outputMergerStage.input(&_depthState);
         _outputMergerStage.input(&_depthRange);
         _outputMergerStage.output(&_renderTarget);
-
-        VertexCache::InitializeCache();
-        _inputAssemblyStage.prepareReadPrimitive();
-        _rasterizeStage.prepareRasterize();
-
-        _inputAssemblyStage.executeVertexLoop();
+        _outputMergerStage.output(&_depthTileCompression);
+        _outputMergerStage.output(&_colorTileClear);
     }
 
-    void RenderingContext::outputVertex(VertexCacheEntry* entry)
+    void RenderingContext::unbindShaderObjects()
     {
-        const VertexDataA* vertexPreTL = &(entry->vertexPreTL);
-        VertexDataB* vertexPostTL = &(entry->vertexPostTL);
+        _vertexShaderProgram = _boundVertexShaderProgram;
+        _fragmentShaderObject = nullptr;
 
-        _vertexShaderStage.executeShader(vertexPreTL, vertexPostTL);
+        // 関数ポインタのシェーダ用のカーネルに戻す
+        _dirtyStateBits |= kDirtyRasterizerState;
     }
 
-    void RenderingContext::outputPrimitive(PrimitiveType primitiveType, VertexCacheEntry** entries, int vertexNum)
+    void RenderingContext::updateDerivedState()
     {
-        VertexDataB* vertices[3];
+        if (0 == _dirtyStateBits)
+        {
+            return;
+        }
 
-        for (int i = 0; i < vertexNum; i++)
+        if (_dirtyStateBits & kDirtyVertexCache)
         {
-            VertexCacheEntry* entry = entries[i];
-            vertices[i] = &(entry->vertexPostTL);
+            _vertexCache.configure(&_vertexCacheState);
         }
 
-        // プリミティブをクリップ
-        VertexDataB clippedVertices[kClippingPointMaxNum];
-        int clippedVertiexNum = 0;
+        if (_dirtyStateBits & kDirtyVaryingIndex)
+        {
+            // 有効な補間変数のインデックスを詰めておく
+            int activeVaryingNum = 0;
+            for (int i = 0; i < kMaxVaryings; i++)
+            {
+                if (_varyingIndexState.enabledVaryingIndexBits & (1u << i))
+                {
+                    _varyingIndexState.activeVaryingIndices[activeVaryingNum] = i;
+                    activeVaryingNum++;
+                }
+            }
+            _varyingIndexState.activeVaryingNum = activeVaryingNum;
+        }
+
+        if (_dirtyStateBits & kDirtyClipRect)
+        {
+            _rasterizeStage.prepareRasterize();
+        }
+
+        if (_dirtyStateBits & kDirtyViewport)
+        {
+            _rasterizeStage.prepareViewportTransform();
+        }
+
+        if (_dirtyStateBits & kDirtyDepthRange)
         {
-            ClipStage clipStage;
-            clipStage.setPrimitiveType(primitiveType);
-            clipStage.setVaryingEnabledBits(&_varyingIndexState);
+            _outputMergerStage.prepareDepthRange();
+        }
 
-            clipStage.clipPrimitive(vertices, vertexNum, clippedVertices, &clippedVertiexNum);
+        // 描画ステートで特殊化したカーネルを選び直す
+        if (_dirtyStateBits & (kDirtyRasterizerState | kDirtyVaryingIndex))
+        {
+            _rasterizeStage.prepareRasterizeKernel();
         }
 
+        if (_dirtyStateBits & kDirtyDepthState)
+        {
+            _outputMergerStage.prepareDepthState();
+        }
+
+        _dirtyStateBits = 0;
+    }
+
+    void RenderingContext::draw(const DrawParam& drawParam)
+    {
+        _drawParam = drawParam;
+        _transientAllocator.reset();
+
+        updateDerivedState();
+
+        _vertexCache.initializeCache();
+        _inputAssemblyStage.prepareReadPrimitive();
+
+        _fragmentBatch.fragmentNum = 0;
+
+        _inputAssemblyStage.executeVertexLoop();
+
+        // 端数のフラグメントを処理
+        flushFragmentBatch();
+    }
+
+    void RenderingContext::outputVertex(const VertexDataA* vertexPreTL, VertexDataB* vertexPostTL)
+    {
+        _vertexShaderStage.executeShader(vertexPreTL, vertexPostTL);
+    }
+
+    void RenderingContext::outputVertexBatch(const VertexDataA* const* vertexPreTLs, VertexDataB* const* vertexPostTLs, int vertexNum, VertexBatchData* vertexBatch)
+    {
+        _vertexShaderStage.executeBatchShader(vertexPreTLs, vertexPostTLs, vertexNum, vertexBatch);
+    }
+
+    void RenderingContext::outputPrimitive(PrimitiveType primitiveType, VertexDataB** vertices, int vertexNum)
+    {
+        // プリミティブをクリップ（頂点はコピーせずポインタで受け取る）
+        const VertexDataB* clippedVertices[kClippingPointMaxNum];
+        int clippedVertiexNum = 0;
+        _clipStage.setPrimitiveType(primitiveType);
+        _clipStage.clipPrimitive(vertices, vertexNum, clippedVertices, &clippedVertiexNum);
+
         // クリップ結果をプリミティブに分割
         PrimitiveAssembly primitiveAssembly;
         primitiveAssembly.setPrimitiveType(primitiveType);
@@ -267,6 +625,16 @@ namespace SoftwareRasterizer
 
     void RenderingContext::outputQuad()
     {
+        if (_fragmentShaderProgram.fragmentBatchShaderMain)
+        {
+            // カバーされたフラグメントだけをバッチに詰める（クアッドやプリミティブをまたいで溜める）
+            appendFragmentBatch(&(_quadFragment.q00));
+            appendFragmentBatch(&(_quadFragment.q01));
+            appendFragmentBatch(&(_quadFragment.q10));
+            appendFragmentBatch(&(_quadFragment.q11));
+            return;
+        }
+
         _fragmentShaderStage.execute();
 
         const FragmentData* fragment;
@@ -301,4 +669,73 @@ namespace SoftwareRasterizer
         }
     }
 
+    void RenderingContext::appendFragmentBatch(const FragmentData* fragment)
+    {
+        if (!fragment->pixelCovered)
+        {
+            return;
+        }
+
+        int lane = _fragmentBatch.fragmentNum;
+        _fragmentBatch.pixelCoords[lane] = fragment->pixelCoord;
+        _fragmentBatch.fragCoord[0][lane] = fragment->wndCoord.x;
+        _fragmentBatch.fragCoord[1][lane] = fragment->wndCoord.y;
+        _fragmentBatch.fragCoord[2][lane] = fragment->depth;
+        _fragmentBatch.fragCoord[3][lane] = fragment->invW;
+        for (int j = 0; j < _varyingIndexState.activeVaryingNum; j++)
+        {
+            int i = _varyingIndexState.activeVaryingIndices[j];
+            _fragmentBatch.varyings[i][0][lane] = fragment->varyings[i].x;
+            _fragmentBatch.varyings[i][1][lane] = fragment->varyings[i].y;
+            _fragmentBatch.varyings[i][2][lane] = fragment->varyings[i].z;
+            _fragmentBatch.varyings[i][3][lane] = fragment->varyings[i].w;
+        }
+        _fragmentBatch.fragmentNum++;
+
+        if (kFragmentBatchSize <= _fragmentBatch.fragmentNum)
+        {
+            flushFragmentBatch();
+        }
+    }
+
+    void RenderingContext::flushFragmentBatch()
+    {
+        if (0 == _fragmentBatch.fragmentNum)
+        {
+            return;
+        }
+
+        _fragmentShaderStage.executeBatch();
+
+        // 深度テストの順序を保つためレーン順にマージする
+        for (int i = 0; i < _fragmentBatch.fragmentNum; i++)
+        {
+            PixelData pixel;
+            pixel.color = Vector4(_pixelBatch.color[0][i], _pixelBatch.color[1][i], _pixelBatch.color[2][i], _pixelBatch.color[3][i]);
+            pixel.depth = _pixelBatch.depth[i];
+            _outputMergerStage.execute(_fragmentBatch.pixelCoords[i], &pixel);
+        }
+
+        _fragmentBatch.fragmentNum = 0;
+    }
+
+    bool RenderingContext::beginDepthTiles(const DepthPlane& plane, int minX, int minY, int maxX, int maxY)
+    {
+        // 前のプリミティブのフラグメントを先に書き込んでおく
+        flushFragmentBatch();
+
+        return _outputMergerStage.beginDepthTiles(plane, minX, minY, maxX, maxY);
+    }
+
+    void RenderingContext::finishDepthTiles()
+    {
+        if (_depthTileCompression.getPendingTiles().empty())
+        {
+            return;
+        }
+
+        flushFragmentBatch();
+        _outputMergerStage.finishDepthTiles();
+    }
+
 }
@@ -6,12 +6,18 @@
 #include "Pipeline\FragmentShaderStage.h"
 #include "Pipeline\OutputMergerStage.h"
 #include "Modules\VertexCache.h"
+#include "Modules\ClipStage.h"
+#include "Modules\LinearAllocator.h"
+#include "Modules\DepthTileCompression.h"
+#include "Modules\ColorTileClear.h"
+#include "CommandBuffer.h"
 #include "State\WindowSize.h"
 #include "State\RenderTarget.h"
 #include "State\ClearParam.h"
 #include "State\InputLayout.h"
 #include "State\VertexBuffers.h"
 #include "State\IndexBuffer.h"
+#include "State\DrawParam.h"
 #include "State\ConstantBuffer.h"
 #include "State\VertexShaderProgram.h"
 #include "State\RasterizerState.h"
@@ -20,8 +26,11 @@
 #include "State\FragmentShaderProgram.h"
 #include "State\DepthState.h"
 #include "State\VaryingIndexState.h"
+#include "State\VertexCacheState.h"
+#include "State\VertexProcessingState.h"
 #include "Core\Types.h"
 #include <cstdint>
+#include <vector>
 
 namespace SoftwareRasterizer
 {
@@ -36,8 +45,10 @@ namespace SoftwareRasterizer
         int getWindowWidth() const;
         int getWindowHeight() const;
 
+        // カラーと深度は内部のタイル配置のバッファに描画し、resolveRenderTarget() でカラーバッファへ書き出す
         void setRenderTargetColorBuffer(void* addr, int width, int height, int widthBytes);
-        void setRenderTargetDepthBuffer(void* addr, int width, int height, int widthBytes);
+        void resolveRenderTarget();
+        void setDepthFormat(DepthFormat depthFormat);// 深度バッファの内容は破棄される
 
         void setClearColor(float red, float green, float blue, float alpha);// glClearColor
         void setClearDepth(float depth);// glClearDepth
@@ -48,13 +59,23 @@ namespace SoftwareRasterizer
         void enableVertexAttribute(int index);// glEnableVertexAttribArray
         void disableVertexAttribute(int index);// glDisableVertexAttribArray
         void setVertexAttribute(int index, int size, ComponentDataType type, size_t stride, const void* buffer);// glVertexAttribPointer
+        void setVertexAttributeDivisor(int index, int divisor);// glVertexAttribDivisor
 
         void setIndexBuffer(const uint16_t* indices, int indexNum);// glBufferData
+        void setIndexBuffer(const uint32_t* indices, int indexNum);// glBufferData
+        void enablePrimitiveRestart();// glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX)
+        void disablePrimitiveRestart();// glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX)
 
         void enableVarying(int index);
         void disableVarying(int index);
 
-        void setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain);// glUseProgram
+        void setVertexCacheSize(int entryNum);
+        void setVertexCacheReplacementPolicy(VertexCacheReplacementPolicy replacementPolicy);
+
+        void setVertexProcessingMode(VertexProcessingMode vertexProcessingMode);
+        void setVertexProcessingThreadNum(int threadNum);
+
+        void setVertexShaderProgram(VertexShaderFuncPtr vertexShaderMain, VertexBatchShaderFuncPtr vertexBatchShaderMain = nullptr);// glUseProgram
 
         void setViewport(int x, int y, int width, int height);// glViewport
         int getViewportWidth() const;
@@ -65,20 +86,52 @@ namespace SoftwareRasterizer
         void setFrontFaceMode(FrontFaceMode frontFaceMode);// glFrontFace
         void setCullFaceMode(CullFaceMode cullFaceMode);// glCullFace
 
-        void setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain);// glUseProgram
+        void setFragmentShaderProgram(FragmentShaderFuncPtr fragmentShaderMain, FragmentBatchShaderFuncPtr fragmentBatchShaderMain = nullptr);// glUseProgram
 
         void setDepthFunc(ComparisonFunc depthFunc);// glDepthFunc
 
-        void drawIndexed(PrimitiveTopologyType primitiveTopologyType);
+        void drawIndexed(PrimitiveTopologyType primitiveTopologyType);// glDrawElements
+        void drawIndexedBaseVertex(PrimitiveTopologyType primitiveTopologyType, int first, int count, int baseVertex);// glDrawElementsBaseVertex
+        void drawArrays(PrimitiveTopologyType primitiveTopologyType, int first, int count);// glDrawArrays
+        void drawIndexedInstanced(PrimitiveTopologyType primitiveTopologyType, int instanceCount);// glDrawElementsInstanced
+        void multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount);// glMultiDrawElementsIndirect
+
+        // シェーダを関数オブジェクトで渡す版（ラスタライズからマージまでをシェーダの組ごとに展開する）
+        // VertexShader / FragmentShader は VertexShaderFuncPtr / FragmentShaderFuncPtr と同じ引数の operator() const を持つ型
+        // 設定済みのシェーダプログラムは変更しない
+        template<class VertexShader, class FragmentShader>
+        void drawIndexed(PrimitiveTopologyType primitiveTopologyType, const VertexShader& vertexShader, const FragmentShader& fragmentShader);
+        template<class VertexShader, class FragmentShader>
+        void multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount, const VertexShader& vertexShader, const FragmentShader& fragmentShader);
+
+        void executeCommandBuffer(const CommandBuffer* commandBuffer);
 
     private:
 
-        void outputVertex(VertexCacheEntry* entry);
+        void draw(const DrawParam& drawParam);
+
+        void bindStages();
+        void updateDerivedState();
+
+        template<class VertexShader, class FragmentShader>
+        void bindShaderObjects(const VertexShader& vertexShader, const FragmentShader& fragmentShader);
+        void unbindShaderObjects();
 
-        void outputPrimitive(PrimitiveType primitiveType, VertexCacheEntry** entries, int vertexNum);
+        void outputVertex(const VertexDataA* vertexPreTL, VertexDataB* vertexPostTL);
+        void outputVertexBatch(const VertexDataA* const* vertexPreTLs, VertexDataB* const* vertexPostTLs, int vertexNum, VertexBatchData* vertexBatch);
 
+        void outputPrimitive(PrimitiveType primitiveType, VertexDataB** vertices, int vertexNum);
+
+        void outputQuad();
+        template<class FragmentShader>
         void outputQuad();
 
+        void appendFragmentBatch(const FragmentData* fragment);
+        void flushFragmentBatch();
+
+        bool beginDepthTiles(const DepthPlane& plane, int minX, int minY, int maxX, int maxY);
+        void finishDepthTiles();
+
     private:
 
         WindowSize _windowSize;
@@ -87,6 +140,9 @@ namespace SoftwareRasterizer
         InputLayout _inputLayout;                       // IA
         VertexBuffers _vertexBuffers;                   // IA
         IndexBuffer _indexBuffer;                       // IA
+        DrawParam _drawParam;                           // IA
+        VertexCacheState _vertexCacheState;             // IA
+        VertexProcessingState _vertexProcessingState;   // IA
         VaryingIndexState _varyingIndexState;           // RS
         VertexShaderProgram _vertexShaderProgram;       // VS
         RasterizerState _rasterizerState;               // RS
@@ -96,6 +152,21 @@ namespace SoftwareRasterizer
         RenderTarget _renderTarget;                     // OM
         DepthState _depthState;                         // OM
 
+    private:
+
+        // 前回の描画から変更された状態（派生する定数を描画時に作り直す）
+        enum DirtyStateBits : uint32_t
+        {
+            kDirtyClipRect = (1u << 0),        // WindowSize / Viewport
+            kDirtyViewport = (1u << 1),        // Viewport
+            kDirtyDepthRange = (1u << 2),      // DepthRange
+            kDirtyVaryingIndex = (1u << 3),    // VaryingIndexState
+            kDirtyVertexCache = (1u << 4),     // VertexCacheState
+            kDirtyRasterizerState = (1u << 5), // RasterizerState
+            kDirtyDepthState = (1u << 6),      // DepthState
+        };
+
+        uint32_t _dirtyStateBits = ~0u;
 
     private:
 
@@ -106,16 +177,129 @@ namespace SoftwareRasterizer
         FragmentShaderStage _fragmentShaderStage;   // PS
         OutputMergerStage _outputMergerStage;       // OM
 
+        VertexCache _vertexCache;                   // IA / VS
+        ClipStage _clipStage;                       // RS
+
+        // 描画ごとの一時データ（描画の先頭でまとめて破棄）
+        LinearAllocator _transientAllocator;
+
+        void allocateDepthTiles();
+
+        // タイル配置のカラーと深度
+        std::vector<RenderTargetTile> _colorTiles;
+        std::vector<RenderTargetTile> _depthTiles;
+
+        // カラータイルの高速クリアと深度タイルの平面圧縮
+        ColorTileClear _colorTileClear;
+        DepthTileCompression _depthTileCompression;
+
+        // 関数オブジェクトのシェーダ（テンプレート版の描画中のみ）
+        VertexShaderProgram _boundVertexShaderProgram;
+        const void* _fragmentShaderObject = nullptr;
+
         friend class InputAssemblyStage;
         friend class VertexShaderStage;
         friend class RasterizeStage;
         friend class FragmentShaderStage;
         friend class OutputMergerStage;
+        template<class FragmentShader>
+        friend struct FragmentBackEnd;
 
         // パイプライン間で受け渡しされるデータ
         SubspanData _quadFragment = {};
         QuadPixelData _quadPixel = {};
+        FragmentBatchData _fragmentBatch = {};
+        PixelBatchData _pixelBatch = {};
+
+    };
 
+    template<class VertexShader, class FragmentShader>
+    void RenderingContext::drawIndexed(PrimitiveTopologyType primitiveTopologyType, const VertexShader& vertexShader, const FragmentShader& fragmentShader)
+    {
+        DrawParam drawParam;
+        drawParam.primitiveTopologyType = primitiveTopologyType;
+        drawParam.indexed = true;
+        drawParam.first = 0;
+        drawParam.count = _indexBuffer.indexNum;
+        drawParam.baseVertex = 0;
+
+        bindShaderObjects(vertexShader, fragmentShader);
+        draw(drawParam);
+        unbindShaderObjects();
+    }
+
+    template<class VertexShader, class FragmentShader>
+    void RenderingContext::multiDrawIndexedIndirect(PrimitiveTopologyType primitiveTopologyType, const DrawIndexedIndirectCommand* commands, int drawCount, const VertexShader& vertexShader, const FragmentShader& fragmentShader)
+    {
+        bindShaderObjects(vertexShader, fragmentShader);
+        multiDrawIndexedIndirect(primitiveTopologyType, commands, drawCount);
+        unbindShaderObjects();
+    }
+
+    template<class VertexShader, class FragmentShader>
+    void RenderingContext::bindShaderObjects(const VertexShader& vertexShader, const FragmentShader& fragmentShader)
+    {
+        // 関数ポインタのシェーダは退避しておく
+        _boundVertexShaderProgram = _vertexShaderProgram;
+
+        _vertexShaderProgram.vertexShaderMain = nullptr;
+        _vertexShaderProgram.vertexBatchShaderMain = nullptr;
+        _vertexShaderProgram.vertexShaderObject = &vertexShader;
+        _vertexShaderProgram.vertexShaderObjectMain = &CallVertexShaderObject<VertexShader>;
+
+        _fragmentShaderObject = &fragmentShader;
+
+        updateDerivedState();
+        _rasterizeStage.prepareRasterizeKernel<FragmentShader>();
+    }
+
+    template<class FragmentShader>
+    void RenderingContext::outputQuad()
+    {
+        const FragmentShader* fragmentShader = static_cast<const FragmentShader*>(_fragmentShaderObject);
+
+        const FragmentData* fragments[4] =
+        {
+            &(_quadFragment.q00),
+            &(_quadFragment.q01),
+            &(_quadFragment.q10),
+            &(_quadFragment.q11),
+        };
+
+        for (const FragmentData* fragment : fragments)
+        {
+            if (!fragment->pixelCovered)
+            {
+                continue;
+            }
+
+            FragmentShaderInput fragmentShaderInput;
+            fragmentShaderInput.uniformBlock = _constantBuffer.uniformBlock;
+            fragmentShaderInput.fragCoord = Vector4(fragment->wndCoord, fragment->depth, fragment->invW);
+            fragmentShaderInput.varyings = fragment->varyings;
+
+            FragmentShaderOutput fragmentShaderOutput;
+            (*fragmentShader)(&fragmentShaderInput, &fragmentShaderOutput);
+
+            PixelData pixel;
+            pixel.color = fragmentShaderOutput.fragColor;
+            pixel.depth = fragment->depth;
+            _outputMergerStage.execute(fragment->pixelCoord, &pixel);
+        }
+    }
+
+    // 関数ポインタのシェーダ
+    template<>
+    struct FragmentBackEnd<void>
+    {
+        static void outputQuad(RenderingContext* renderingContext) { renderingContext->outputQuad(); }
+    };
+
+    // 関数オブジェクトのシェーダ
+    template<class FragmentShader>
+    struct FragmentBackEnd
+    {
+        static void outputQuad(RenderingContext* renderingContext) { renderingContext->outputQuad<FragmentShader>(); }
     };
 
 }
@@ -1,20 +1,45 @@
 ﻿#include "SamplerUtility.h"
+#include <cmath>// sqrt log2
+#include <algorithm>// max
+#include <cassert>
 
 namespace SoftwareRasterizer
 {
+    // LOD が 0 より大きければ縮小フィルタ（[1]）を使う
+    static int SelectSampleFuncIndex(float lod)
+    {
+        return (0.0f < lod) ? 1 : 0;
+    }
+
     Vector4 SamplerUtility::SampleTexture2d(const Sampler2D* sampler, const Vector2& texcoord)
     {
+        int index = SelectSampleFuncIndex(sampler->lodBias);
+        assert(sampler->sampleFuncs[index] != nullptr);
+
+        return sampler->sampleFuncs[index](sampler, texcoord);
+    }
+
+    Vector4 SamplerUtility::SampleTexture2dGrad(const Sampler2D* sampler, const Vector2& texcoord, const Vector2& dPdx, const Vector2& dPdy)
+    {
+        float width = (float)sampler->texture->width;
+        float height = (float)sampler->texture->height;
+
+        // テクセル単位の微分の長い方
+        float dx = std::sqrt((dPdx.x * width * dPdx.x * width) + (dPdx.y * height * dPdx.y * height));
+        float dy = std::sqrt((dPdy.x * width * dPdy.x * width) + (dPdy.y * height * dPdy.y * height));
+        float lod = std::log2(std::max(dx, dy)) + sampler->lodBias;
+
+        int index = SelectSampleFuncIndex(lod);
+        assert(sampler->sampleFuncs[index] != nullptr);
+
+        return sampler->sampleFuncs[index](sampler, texcoord);
+    }
+
+    void SamplerUtility::SampleTexture2dBatch(const Sampler2D* sampler, const float (*texcoords)[kFragmentBatchSize], uint32_t activeMask, float (*colors)[kFragmentBatchSize])
+    {
+        int index = SelectSampleFuncIndex(sampler->lodBias);
+        assert(sampler->sampleBatchFuncs[index] != nullptr);
 
-        FilterType filter = sampler->filter;
-
-        switch(filter)
-        {
-            case FilterType::kPoint:
-                return TextureMappingUnit::SampleNearestPoint(sampler, texcoord);
-            case FilterType::kBilinear:
-                return TextureMappingUnit::SampleBilinearInterpolation(sampler, texcoord);
-            default:
-                return Vector4::kZero;
-        }
+        sampler->sampleBatchFuncs[index](sampler, texcoords, activeMask, colors);
     }
 }
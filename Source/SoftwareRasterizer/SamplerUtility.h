@@ -12,8 +12,16 @@ namespace SoftwareRasterizer
 
     public:
 
+        // sampler は TextureMappingUnit::CompileSampler 済みであること
+        // ミップマップも微分も無いので、LOD は lodBias だけで拡大と縮小を選ぶ
         static Vector4 SampleTexture2d(const Sampler2D* sampler, const Vector2& texcoord);// texture2D
 
+        // テクスチャ座標の微分から LOD を求めて拡大と縮小を選ぶ
+        static Vector4 SampleTexture2dGrad(const Sampler2D* sampler, const Vector2& texcoord, const Vector2& dPdx, const Vector2& dPdy);// textureGrad
+
+        // バッチ版（texcoords は [uv][lane]、colors は [rgba][lane]）
+        static void SampleTexture2dBatch(const Sampler2D* sampler, const float (*texcoords)[kFragmentBatchSize], uint32_t activeMask, float (*colors)[kFragmentBatchSize]);
+
     };
 
 }
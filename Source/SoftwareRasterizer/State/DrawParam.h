@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include "..\Core\Types.h"
+
+namespace SoftwareRasterizer
+{
+    struct DrawParam
+    {
+        PrimitiveTopologyType primitiveTopologyType = PrimitiveTopologyType::kNone;
+        bool indexed = false;
+        int first = 0;          // インデックス描画では先頭のインデックス、非インデックス描画では先頭の頂点
+        int count = 0;
+        int baseVertex = 0;     // インデックスに加算（インデックス描画のみ）
+        int instanceCount = 1;
+    };
+
+    // multiDrawIndexedIndirect が読む描画引数
+    struct DrawIndexedIndirectCommand
+    {
+        int indexCount;
+        int firstIndex;
+        int baseVertex;
+        int instanceCount;
+    };
+}
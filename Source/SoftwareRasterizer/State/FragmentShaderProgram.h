@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "..\Core\Types.h"
+#include <cstdint>
 
 namespace SoftwareRasterizer
 {
@@ -18,8 +19,26 @@ namespace SoftwareRasterizer
 
     typedef void (*FragmentShaderFuncPtr)(const FragmentShaderInput* input, FragmentShaderOutput* output);
 
+    // kFragmentBatchSize 個のフラグメントを SoA でまとめて処理するエントリポイント
+    // activeMask のビットが立っていないレーンの値は不定
+    struct FragmentBatchShaderInput
+    {
+        const void* uniformBlock;
+        uint32_t activeMask;
+        const float (*fragCoord)[kFragmentBatchSize];               // gl_FragCoord [xyzw][lane]
+        const float (*varyings)[4][kFragmentBatchSize];             // [varying][xyzw][lane]
+    };
+
+    struct FragmentBatchShaderOutput
+    {
+        float fragColor[4][kFragmentBatchSize];                     // gl_FragColor [rgba][lane]
+    };
+
+    typedef void (*FragmentBatchShaderFuncPtr)(const FragmentBatchShaderInput* input, FragmentBatchShaderOutput* output);
+
     struct FragmentShaderProgram
     {
         FragmentShaderFuncPtr fragmentShaderMain = nullptr;
+        FragmentBatchShaderFuncPtr fragmentBatchShaderMain = nullptr;// 省略可
     };
 }
@@ -5,9 +5,21 @@
 
 namespace SoftwareRasterizer
 {
+    enum class IndexType
+    {
+        kUnsignedShort, // GL_UNSIGNED_SHORT
+        kUnsignedInt,   // GL_UNSIGNED_INT
+    };
+
+    // GL_PRIMITIVE_RESTART_FIXED_INDEX
+    const uint32_t kPrimitiveRestartIndex16 = 0xFFFF;
+    const uint32_t kPrimitiveRestartIndex32 = 0xFFFFFFFF;
+
     struct IndexBuffer
     {
-        const uint16_t* indices = nullptr;
+        const void* indices = nullptr;
+        IndexType indexType = IndexType::kUnsignedShort;
         int indexNum = 0;
+        bool primitiveRestartEnabled = false;// ストリップ、ファン、ループのみ
     };
 }
@@ -18,6 +18,7 @@ namespace SoftwareRasterizer
         ComponentDataType type = ComponentDataType::kNone;  // 頂点属性の各コンポーネントのデータ型
         bool normalized = false;                            // 整数値を[0,1]に正規化するか
         size_t stride = 0;                                  // 頂点属性間のバイトオフセット
+        int divisor = 0;                                    // 0 なら頂点ごと、1 以上ならこのインスタンス数ごとに進める
     };
 
     struct InputLayout
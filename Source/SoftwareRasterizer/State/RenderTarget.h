@@ -1,12 +1,30 @@
 ﻿#pragma once
 
 #include "Texture2D.h"
+#include <cstdint>
 
 namespace SoftwareRasterizer
 {
+    enum class DepthFormat
+    {
+        kD16,       // GL_DEPTH_COMPONENT16
+        kD24S8,     // GL_DEPTH24_STENCIL8
+        kD32F,      // GL_DEPTH_COMPONENT32F
+        kDefault = kD24S8,
+    };
+
+    // タイル１枚分のテクセル（2x2 のクアッドが同じキャッシュラインに収まる）
+    struct alignas(64) RenderTargetTile
+    {
+        uint32_t texels[kTextureTileTexelNum];
+    };
+
     struct RenderTarget
     {
-        Texture2D colorBuffer;// uint32_t[], BGRA
-        Texture2D depthBuffer;// float[]
+        Texture2D colorBuffer;// RenderTargetTile[], BGRA
+        Texture2D depthBuffer;// RenderTargetTile[], depthFormat
+        Texture2D resolveBuffer;// uint32_t[], BGRA（リニア、フレームの最後に書き出す先）
+
+        DepthFormat depthFormat = DepthFormat::kDefault;
     };
 }
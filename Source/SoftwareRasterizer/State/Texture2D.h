@@ -4,6 +4,30 @@
 
 namespace SoftwareRasterizer
 {
+    enum class TextureLayout
+    {
+        kLinear,    // 行ごとに並べる（widthBytes は１行のバイト数）
+        kTiled,     // 8x8 のタイルごとに並べる（widthBytes はタイル１行分のバイト数）
+        kSwizzled,  // 32x32 のブロックごとに並べ、ブロック内は Morton 順（widthBytes はブロック１行分のバイト数）
+        kDefault = kLinear,
+    };
+
+    enum class TextureFormat
+    {
+        kR8G8B8A8,  // GL_RGBA8
+        kBC1,       // ４x４テクセルを８バイト（RGB + 1 ビットアルファ）
+        kBC3,       // ４x４テクセルを 16 バイト（RGB + 補間アルファ）
+        kBC7,       // ４x４テクセルを 16 バイト（RGBA、モード 0～7）
+        kDefault = kR8G8B8A8,
+    };
+
+    const int kTextureTileSizeLog2 = 3;
+    const int kTextureTileSize = 1 << kTextureTileSizeLog2;// 8x8
+    const int kTextureTileTexelNum = kTextureTileSize * kTextureTileSize;
+
+    const int kTextureSwizzleBlockSizeLog2 = 5;
+    const int kTextureSwizzleBlockSize = 1 << kTextureSwizzleBlockSizeLog2;// 32x32
+    const int kTextureSwizzleBlockTexelNum = kTextureSwizzleBlockSize * kTextureSwizzleBlockSize;
 
     struct Texture2D
     {
@@ -11,9 +35,8 @@ namespace SoftwareRasterizer
         int width = 0;
         int height = 0;
         int widthBytes = 0;
-
-        //internalformat = 4
-        //format = GL_RGBA
+        TextureLayout layout = TextureLayout::kDefault;
+        TextureFormat format = TextureFormat::kDefault;// 圧縮フォーマットはリニア配置のみ（widthBytes はブロック１行分のバイト数）
     };
 
 }
@@ -1,13 +1,19 @@
 ﻿#pragma once
 
+#include "..\Core\Types.h"
 #include <cstdint>
 
 namespace SoftwareRasterizer
 {
+    // 補間変数の数をテンプレート引数で固定しない（activeVaryingNum を使う）
+    const int kDynamicVaryingNum = -1;
+
     struct VaryingIndexState
     {
         uint32_t enabledVaryingIndexBits = 0;
 
-        //int numVaryings = 0:
+        // enabledVaryingIndexBits から作る（描画時に RenderingContext が更新）
+        int activeVaryingIndices[kMaxVaryings] = {};
+        int activeVaryingNum = 0;
     };
 }
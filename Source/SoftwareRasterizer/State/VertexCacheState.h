@@ -0,0 +1,20 @@
+﻿#pragma once
+
+namespace SoftwareRasterizer
+{
+    const int kVertexCacheMinEntryNum = 16;
+    const int kVertexCacheMaxEntryNum = 256;
+
+    enum class VertexCacheReplacementPolicy
+    {
+        kLRU,
+        kFIFO,
+        kDefault = kLRU,
+    };
+
+    struct VertexCacheState
+    {
+        int entryNum = kVertexCacheMinEntryNum;
+        VertexCacheReplacementPolicy replacementPolicy = VertexCacheReplacementPolicy::kDefault;
+    };
+}
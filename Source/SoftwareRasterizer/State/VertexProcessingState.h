@@ -0,0 +1,17 @@
+﻿#pragma once
+
+namespace SoftwareRasterizer
+{
+    enum class VertexProcessingMode
+    {
+        kVertexCache,   // インデックス順に頂点キャッシュを通してシェーディング
+        kPreTransform,  // 参照される範囲の頂点を先に並列でシェーディング（シェーダーは複数スレッドから呼ばれる）
+        kDefault = kVertexCache,
+    };
+
+    struct VertexProcessingState
+    {
+        VertexProcessingMode vertexProcessingMode = VertexProcessingMode::kDefault;
+        int threadNum = 0;// 0 のときはハードウェアスレッド数
+    };
+}
@@ -9,6 +9,7 @@ namespace SoftwareRasterizer
         const void* uniformBlock;
         const Vector4* attributes;
         int vertexId;       // gl_VertexID
+        int instanceId;     // gl_InstanceID
     };
 
     struct VertexShaderOutput
@@ -19,8 +20,41 @@ namespace SoftwareRasterizer
 
     typedef void (*VertexShaderFuncPtr)(const VertexShaderInput* input, VertexShaderOutput* output);
 
+    // 複数の頂点を SoA でまとめて処理するエントリポイント
+    // vertexNum 以降のレーンの値は不定
+    struct VertexBatchShaderInput
+    {
+        const void* uniformBlock;
+        int vertexNum;                                          // 1 ～ kVertexBatchMaxSize
+        const int* vertexIds;                                   // gl_VertexID [lane]
+        int instanceId;                                         // gl_InstanceID（全レーン共通）
+        const float (*attributes)[4][kVertexBatchMaxSize];      // [attribute][xyzw][lane]
+    };
+
+    struct VertexBatchShaderOutput
+    {
+        float (*position)[kVertexBatchMaxSize];                 // gl_Position [xyzw][lane]
+        float (*varyings)[4][kVertexBatchMaxSize];              // [varying][xyzw][lane]
+    };
+
+    typedef void (*VertexBatchShaderFuncPtr)(const VertexBatchShaderInput* input, VertexBatchShaderOutput* output);
+
+    // 関数オブジェクトのシェーダを呼ぶエントリポイント（シェーダの型ごとに生成する）
+    typedef void (*VertexShaderObjectFuncPtr)(const void* shaderObject, const VertexShaderInput* input, VertexShaderOutput* output);
+
+    template<class VertexShader>
+    void CallVertexShaderObject(const void* shaderObject, const VertexShaderInput* input, VertexShaderOutput* output)
+    {
+        (*static_cast<const VertexShader*>(shaderObject))(input, output);
+    }
+
     struct VertexShaderProgram
     {
         VertexShaderFuncPtr vertexShaderMain = nullptr;
+        VertexBatchShaderFuncPtr vertexBatchShaderMain = nullptr;// 省略可
+
+        // 設定されていれば vertexShaderMain より優先する
+        const void* vertexShaderObject = nullptr;
+        VertexShaderObjectFuncPtr vertexShaderObjectMain = nullptr;
     };
 }
@@ -3,3 +3,4 @@
 
 #include "MatrixUtility.h"
 #include "SamplerUtility.h"
+#include "MeshOptimizer.h"